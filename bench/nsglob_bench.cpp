@@ -0,0 +1,174 @@
+// Compares the glob file list as a vector of std::filesystem::path against nsfileset on a media tree sized list:
+// building it from a walk, sorting it and writing it relative to the generated CMakeLists.txt directory.
+#include "nsfileset.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+std::size_t s_live   = 0;
+std::size_t s_allocs = 0;
+// Allocations carry their size in front, aligned like operator new expects
+constexpr std::size_t k_prefix = alignof(std::max_align_t);
+} // namespace
+
+void* operator new(std::size_t size)
+{
+  auto p = static_cast<char*>(std::malloc(size + k_prefix));
+  if (!p)
+    throw std::bad_alloc();
+  *reinterpret_cast<std::size_t*>(p) = size;
+  s_live += size;
+  s_allocs++;
+  return p + k_prefix;
+}
+
+void operator delete(void* p) noexcept
+{
+  if (!p)
+    return;
+  auto base = static_cast<char*>(p) - k_prefix;
+  s_live -= *reinterpret_cast<std::size_t*>(base);
+  std::free(base);
+}
+
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+
+namespace
+{
+using clock = std::chrono::steady_clock;
+
+struct walked_dir
+{
+  std::string              dir;
+  std::vector<std::string> leaves;
+};
+
+double ms_since(clock::time_point start) { return std::chrono::duration<double, std::milli>(clock::now() - start).count(); }
+
+/// @brief Directories as workers report them, in no particular order
+std::vector<walked_dir> make_tree(std::size_t files)
+{
+  std::mt19937             rng(42);
+  std::vector<walked_dir>  dirs;
+  std::vector<std::string> kinds = {"textures", "meshes", "sounds", "shaders", "levels", "ui"};
+  std::vector<std::string> exts  = {".png", ".dds", ".fbx", ".ogg", ".glsl", ".json"};
+  std::string              root  = "/home/user/work/project/Frameworks/Engine/Assets/media";
+  for (std::size_t n = 0, d = 0; n < files; ++d)
+  {
+    walked_dir w;
+    w.dir = root + "/" + kinds[d % kinds.size()] + "/pack_" + std::to_string(d / kinds.size() % 40) + "/set_" +
+            std::to_string(d);
+    for (std::size_t i = 0, count = 50 + rng() % 150; i < count && n < files; ++i, ++n)
+      w.leaves.push_back("asset_" + std::to_string(rng() % 100000) + "_" + std::to_string(i) + exts[rng() % exts.size()]);
+    std::shuffle(w.leaves.begin(), w.leaves.end(), rng);
+    dirs.emplace_back(std::move(w));
+  }
+  std::shuffle(dirs.begin(), dirs.end(), rng);
+  return dirs;
+}
+
+struct result
+{
+  double      build_ms = 0;
+  double      sort_ms  = 0;
+  double      print_ms = 0;
+  std::size_t bytes    = 0;
+  std::size_t allocs   = 0;
+  std::size_t out_size = 0;
+};
+
+result run_paths(std::vector<walked_dir> const& tree, std::filesystem::path const& base)
+{
+  result r;
+  auto   live   = s_live;
+  auto   allocs = s_allocs;
+  {
+    auto                               start = clock::now();
+    std::vector<std::filesystem::path> files;
+    for (auto const& d : tree)
+    {
+      std::filesystem::path dir = d.dir;
+      for (auto const& l : d.leaves)
+        files.emplace_back(std::filesystem::absolute(dir / l).lexically_normal());
+    }
+    r.build_ms = ms_since(start);
+    r.bytes    = s_live - live;
+
+    start = clock::now();
+    std::ranges::sort(files);
+    r.sort_ms = ms_since(start);
+
+    start = clock::now();
+    std::ostringstream oss;
+    for (auto const& f : files)
+      oss << "\n\t${CMAKE_CURRENT_LIST_DIR}/" << std::filesystem::relative(f, base).generic_string();
+    r.print_ms = ms_since(start);
+    r.out_size = oss.str().size();
+  }
+  r.allocs = s_allocs - allocs;
+  return r;
+}
+
+result run_fileset(std::vector<walked_dir> const& tree, std::filesystem::path const& base)
+{
+  result r;
+  auto   live   = s_live;
+  auto   allocs = s_allocs;
+  {
+    auto      start = clock::now();
+    nsfileset files;
+    for (auto const& d : tree)
+    {
+      auto dir = files.add_dir(d.dir);
+      for (auto const& l : d.leaves)
+        files.add(dir, l);
+    }
+    r.build_ms = ms_since(start);
+    r.bytes    = s_live - live;
+
+    start = clock::now();
+    files.sort();
+    r.sort_ms = ms_since(start);
+
+    start = clock::now();
+    std::ostringstream oss;
+    files.for_each_relative(base, [&oss](std::string_view dir, std::string_view leaf)
+                            { oss << "\n\t${CMAKE_CURRENT_LIST_DIR}/" << dir << leaf; });
+    r.print_ms = ms_since(start);
+    r.out_size = oss.str().size();
+  }
+  r.allocs = s_allocs - allocs;
+  return r;
+}
+
+void report(char const* name, result const& r)
+{
+  std::printf("%-12s %10.1f %10.1f %10.1f %12.1f %12zu %12zu\n", name, r.build_ms, r.sort_ms, r.print_ms,
+              static_cast<double>(r.bytes) / (1024.0 * 1024.0), r.allocs, r.out_size);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  std::size_t files = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+  auto        tree  = make_tree(files);
+  // Where the generated CMakeLists.txt of the module would live
+  std::filesystem::path base = "/home/user/work/project/build/cmake";
+
+  std::printf("%zu files in %zu directories\n\n", files, tree.size());
+  std::printf("%-12s %10s %10s %10s %12s %12s %12s\n", "", "build ms", "sort ms", "print ms", "held MB", "allocs",
+              "output");
+  report("path", run_paths(tree, base));
+  report("nsfileset", run_fileset(tree, base));
+  return 0;
+}
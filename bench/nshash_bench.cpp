@@ -0,0 +1,55 @@
+// Compares nshash against picosha2 on input sizes seen during a check:
+// glob listing lines, Module.ns files, joined glob listings, fetch CMakeLists and embedded resources.
+#include "nshash.h"
+#include "picosha2.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+
+namespace
+{
+template <typename L>
+double mb_per_s(std::string const& input, L&& l)
+{
+  using clock = std::chrono::steady_clock;
+  // Enough iterations to run for roughly 64MB per measurement, at least a handful for large inputs
+  std::size_t iterations = std::max<std::size_t>(8, (64u << 20) / std::max<std::size_t>(input.size(), 1));
+  std::size_t sink       = 0;
+  auto        start      = clock::now();
+  for (std::size_t i = 0; i < iterations; ++i)
+    sink += l(input).size();
+  auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  if (!sink)
+    std::puts("");
+  return static_cast<double>(input.size()) * static_cast<double>(iterations) / elapsed / (1024.0 * 1024.0);
+}
+} // namespace
+
+int main()
+{
+  std::mt19937 rng(42);
+  std::printf("SHA extensions: %s\n\n", nshash::has_sha_ni() ? "yes" : "no");
+  std::printf("%10s %14s %14s %14s\n", "bytes", "picosha2 MB/s", "sha256 MB/s", "fast MB/s");
+  for (std::size_t size : {64u, 1024u, 4096u, 65536u, 1048576u, 8388608u})
+  {
+    std::string input(size, '\0');
+    for (auto& c : input)
+      c = static_cast<char>('a' + rng() % 26);
+
+    auto pico = mb_per_s(input,
+                         [](std::string const& s)
+                         {
+                           std::string sha;
+                           picosha2::hash256_hex_string(s, sha);
+                           return sha;
+                         });
+    auto sha  = mb_per_s(input, [](std::string const& s) { return nshash::sha256_hex(s); });
+    auto fast = mb_per_s(input, [](std::string const& s) { return nshash::fast_hex(s); });
+    std::printf("%10zu %14.1f %14.1f %14.1f\n", size, pico, sha, fast);
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+// Compares nsmatcher against std::regex on the names of a large sdk: the shared library filter run on every file
+// name and runtime_files patterns run on every full path, with std::regex built per file as before and once.
+#include "nsmatch.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr char k_dll_ext[] = "(\\.so[\\.0-9]*$)|(\\.json$)|(\\.conf)";
+
+std::vector<std::string> sdk_paths(std::size_t count)
+{
+  std::mt19937                   rng(42);
+  std::vector<std::string> const dirs  = {"/build/sdk/lib/", "/build/sdk/bin/", "/build/sdk/include/foo/detail/",
+                                          "/build/sdk/share/cmake/", "/build/sdk/lib/plugins/"};
+  std::vector<std::string> const exts  = {".h", ".hpp", ".a", ".so", ".so.1", ".so.1.2.3", ".json", ".conf", ".cmake",
+                                          ".pc", ".txt", ".dll", ".pdb"};
+  std::vector<std::string>       paths;
+  paths.reserve(count);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    auto name = "lib" + std::to_string(rng() % 100000) + "_component";
+    paths.push_back(dirs[rng() % dirs.size()] + name + exts[rng() % exts.size()]);
+  }
+  return paths;
+}
+
+template <typename L>
+void measure(char const* what, std::vector<std::string> const& paths, L&& l)
+{
+  using clock        = std::chrono::steady_clock;
+  auto        start  = clock::now();
+  std::size_t result = 0;
+  for (auto const& p : paths)
+    result += l(p);
+  auto elapsed = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+  std::printf("%-36s %10.2f ms %8zu matches\n", what, elapsed, result);
+}
+} // namespace
+
+int main()
+{
+  auto const paths = sdk_paths(50000);
+  std::vector<std::string> names;
+  names.reserve(paths.size());
+  for (auto const& p : paths)
+    names.push_back(p.substr(p.rfind('/') + 1));
+
+  std::printf("%zu files\n\nshared library filter\n", paths.size());
+  auto const dll_regex = std::regex(k_dll_ext, std::regex_constants::icase);
+  auto const dll       = nsmatcher(k_dll_ext, true);
+  measure("std::regex", names, [&](std::string const& n) { return std::regex_search(n, dll_regex) ? 1 : 0; });
+  measure("nsmatcher", names, [&](std::string const& n) { return dll.search(n) ? 1 : 0; });
+
+  std::printf("\nruntime_files\n");
+  std::vector<std::string> const patterns = {"lib[0-9]+_component\\.dll", "plugins/.*\\.so(\\.[0-9]+)*$",
+                                             "share/cmake/lib1[0-9]*_component\\.json"};
+  std::vector<std::regex>        regexes;
+  std::vector<nsmatcher>         matchers;
+  for (auto const& p : patterns)
+  {
+    regexes.emplace_back(p, std::regex_constants::icase);
+    matchers.emplace_back(p, true);
+  }
+  measure("std::regex built per file", paths,
+          [&](std::string const& p)
+          {
+            for (auto const& rt : patterns)
+            {
+              std::smatch m;
+              if (std::regex_search(p, m, std::regex(rt, std::regex_constants::icase)))
+                return static_cast<int>(m[0].length() != 0);
+            }
+            return 0;
+          });
+  measure("std::regex built once", paths,
+          [&](std::string const& p)
+          {
+            for (auto const& re : regexes)
+            {
+              std::smatch m;
+              if (std::regex_search(p, m, re))
+                return static_cast<int>(m[0].length() != 0);
+            }
+            return 0;
+          });
+  measure("nsmatcher", paths,
+          [&](std::string const& p)
+          {
+            for (auto const& m : matchers)
+            {
+              std::size_t start = 0, length = 0;
+              if (m.find(p, start, length))
+                return static_cast<int>(length != 0);
+            }
+            return 0;
+          });
+  return 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/// @brief Extraction of downloaded sources. Zip and tar archives, plain or compressed with gzip, xz or zstd, are
+/// streamed straight into the destination without an intermediate copy. The decompressors are optional
+/// (NSBUILD_HAS_ZLIB, NSBUILD_HAS_LZMA, NSBUILD_HAS_ZSTD), an archive this build cannot read is left to the caller.
+namespace nsarchive
+{
+/// @brief Extracts archive into dest, or only the entries named in only when it is not empty. False, with nothing
+/// written, when the format is not known or its decompressor is not part of this build. Throws on a damaged archive
+/// or an entry that would land outside dest.
+bool extract(std::filesystem::path const& archive, std::filesystem::path const& dest,
+             std::vector<std::string> const& only = {});
+} // namespace nsarchive
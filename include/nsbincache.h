@@ -0,0 +1,28 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct nsbuild;
+
+/// @brief Local cache of fetch installs, shareable between workspaces and presets. An entry is the set of files a
+/// fetch installed into the sdk dir, packed with cmake -E tar under a key that covers everything the build depends
+/// on, and unpacked in place of configuring, building and installing the fetch again.
+namespace nsbincache
+{
+/// @brief Replaces the workspace and preset directories in text, so the same content hashes the same anywhere
+std::string relocatable(nsbuild const& bc, std::string text);
+/// @brief Unpacks the entry for key into prefix and writes its install manifest. Text files that named the
+/// workspace the entry was stored from are rewritten to name this one. False when there is no entry or it cannot be
+/// unpacked.
+bool        restore(nsbuild const& bc, std::string_view key, std::filesystem::path const& prefix,
+                    std::filesystem::path const& manifest);
+/// @brief The files listed in an install manifest relative to prefix. Empty when one of them was installed outside
+/// prefix, such an install is not cached.
+std::vector<std::string> installed_files(std::filesystem::path const& prefix, std::filesystem::path const& manifest);
+/// @brief Packs files, relative to prefix, as the entry for key. Text files holding a workspace directory are listed
+/// for restore to relocate.
+void        store(nsbuild const& bc, std::string_view key, std::filesystem::path const& prefix,
+                  std::vector<std::string> const& files);
+} // namespace nsbincache
@@ -1,16 +1,24 @@
 #pragma once
 #include <future>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <nscmakeinfo.h>
 #include <nscommon.h>
+#include <nsdircache.h>
 #include <nsframework.h>
 #include <nsinstallers.h>
+#include <nsjobserver.h>
+#include <nsjournal.h>
 #include <nsmacros.h>
+#include <nsmatch.h>
+#include <nsmmap.h>
 #include <nsmodule.h>
 #include <nspreset.h>
 #include <nspython.h>
+#include <nsstatcache.h>
+#include <nsstatedb.h>
 #include <nstarget.h>
-#include <regex>
 
 struct nsbuild : public neo::command_handler
 {
@@ -31,6 +39,8 @@ struct nsbuild : public neo::command_handler
   std::string download_dir = "dl";
   // path relative to out/presets
   std::string build_dir = "bld";
+  // path relative to out, an absolute one shares the cache between workspaces, empty turns it off
+  std::string binary_cache_dir = "bincache";
   // path relative to current
   std::string scan_dir = ".";
   // path relative to scan
@@ -52,9 +62,18 @@ struct nsbuild : public neo::command_handler
   std::string macro_prefix;
   std::string file_prefix;
 
-  bool verbose    = false;
-  bool cppcheck   = false;
-  bool has_fmtlib = false;
+  bool verbose       = false;
+  bool cppcheck      = false;
+  bool has_fmtlib    = false;
+  bool parallel_scan = false;
+  // Fetches downloaded at once before modules are processed, 1 downloads each one as its module is processed
+  std::uint32_t fetch_jobs       = 8;
+  // Fetches configured and built at once, those of modules that do not depend on each other
+  std::uint32_t fetch_build_jobs = 4;
+  // Jobs the fetch builds and the builds they run share through a jobserver, 0 for CMAKE_BUILD_PARALLEL_LEVEL or
+  // the core count. A jobserver exported by an outer make or ninja is used instead.
+  std::uint32_t build_jobs       = 0;
+  bool          use_jobserver    = true;
 
   // Project name
   std::string project_name;
@@ -67,7 +86,7 @@ struct nsbuild : public neo::command_handler
 
   std::string natvis;
 
-  std::regex dll_ext;
+  nsmatcher dll_ext;
 
   nscmakeinfo cmakeinfo;
 
@@ -77,8 +96,12 @@ struct nsbuild : public neo::command_handler
 
   std::vector<nspreset> presets;
 
-  neo::registry          reg;
-  std::list<std::string> contents;
+  neo::registry reg;
+  // Read-only mappings of loaded snapshots, the model's string views point into them. Snapshots are only ever
+  // replaced by a rename, so a mapping never changes under the parser.
+  std::list<nsmapped_file>      contents;
+  // Text of parsed .ns files, read rather than mapped since editors rewrite them in place while a check runs
+  std::shared_ptr<nsfile_arena> sources = std::make_shared<nsfile_arena>();
 
   std::unordered_map<std::string, nstarget> targets;
   std::vector<std::string>                  sorted_targets;
@@ -115,6 +138,19 @@ struct nsbuild : public neo::command_handler
   // Install cache
   nsinstallers install_cache;
 
+  // Stat manifest, shared with parallel scan contexts
+  std::shared_ptr<nsstatcache> stat_cache = std::make_shared<nsstatcache>();
+  // Directory listings for globs
+  std::shared_ptr<nsdircache>  dir_cache  = std::make_shared<nsdircache>();
+  // Module, glob and fetch digests
+  std::shared_ptr<nsstatedb>   state_db   = std::make_shared<nsstatedb>();
+  // Paths changed since the last check, from nsbuild --watch
+  std::shared_ptr<nsjournal>   journal    = std::make_shared<nsjournal>();
+  // Held by fetch installs into the sdk dir
+  std::shared_ptr<std::mutex>  sdk_lock   = std::make_shared<std::mutex>();
+  // Jobs shared by the fetch builds while they run
+  std::shared_ptr<nsjobserver> jobserver;
+
   //--------------------------------------
   // Fn
   nsbuild();
@@ -126,11 +162,24 @@ struct nsbuild : public neo::command_handler
   void main_project();
 
   bool scan_file(std::filesystem::path, bool store, std::string* sha = nullptr);
+  bool scan_file(neo::registry&, std::filesystem::path, bool store, std::string* sha = nullptr);
+  /// @brief Reads Module.ns into s_nsmodule, from its snapshot in the cache dir when the module hash matches.
+  /// Modules the watch journal has not seen change reuse their last hash without touching the disk.
+  bool scan_module(neo::registry&, std::filesystem::path const&, std::string& hash);
+  void parse(neo::registry&, std::filesystem::path const&, std::string_view);
   void handle_error(neo::state_machine&);
   void update_macros();
   void process_targets();
+  /// @brief Downloads the fetches of every module at once, fetch_jobs at a time, before the serial processing
+  void prefetch();
+  /// @brief Builds the queued fetches of every module, a module once the modules it depends on are built
+  void build_fetches();
   void process_target(std::string const&, nstarget&);
   void copy_installed_binaries();
+  /// @brief Places a runtime file of the sdk at to, copied or linked as the preset's runtime_deploy says
+  void deploy_runtime(std::filesystem::path const& from, std::filesystem::path const& to) const;
+  /// @brief Walks the globs of every module in one go, unchanged modules only when asked to
+  void accumulate_globs(bool unchanged);
 
   /// @brief This initiates the main build: check mode
   /// - Checks current build directory, if it does not exist creates it
@@ -142,8 +191,13 @@ struct nsbuild : public neo::command_handler
   void act_meta();
   void write_meta(std::filesystem::path const&);
   void scan_main(std::filesystem::path);
+  void read_frameworks();
+  /// @brief Parses every Module.ns on a worker pool, each into its own nsmodule, and merges the
+  /// results into frameworks/targets sorted by framework and module path.
+  void read_frameworks_parallel();
   void read_framework(std::filesystem::path);
   void read_module(std::filesystem::path);
+  void add_target(std::uint32_t fw_idx, std::string const& hash, bool changed);
   void write_include_modules() const;
   void write_install_configs(std::ofstream&) const;
   void delete_builds_if_required();
@@ -151,7 +205,8 @@ struct nsbuild : public neo::command_handler
   bool read_sha(std::string_view name, std::string const& current) const;
   void write_sha(std::string_view name, std::string const& current) const;
 
-  std::string gather_module_hash(std::filesystem::path const&);
+  /// @brief Hash of Module.ns, Prepare.cmake and Finalize.cmake from their stat manifest digests
+  std::string gather_module_hash(std::filesystem::path const&) const;
 
   void write_cxx_options(std::ostream&) const;
 
@@ -159,11 +214,12 @@ struct nsbuild : public neo::command_handler
   /// @param target Should be FwName/ModName or full path to module directory
   void generate_enum(std::string filepfx, std::string apipfx, std::string target, std::string preset);
 
-  /// @brief Copy media directories and files, ignores media/Internal directory
+  /// @brief Deploys the media directory from to to. Files added or changed in manifest since the deployed manifest
+  /// are copied and files no longer in it are removed, then manifest becomes the deployed one.
   /// @param from
   /// @param to
-  static void copy_media(std::filesystem::path from, std::filesystem::path to, std::filesystem::path artefacts,
-                         std::string ignore);
+  static void copy_media(std::filesystem::path from, std::filesystem::path to, std::filesystem::path manifest,
+                         std::filesystem::path deployed);
 
   bool               has_naming() const { return s_current_preset && !s_current_preset->naming.empty(); }
   std::string const& naming() const { return s_current_preset->naming; }
@@ -236,6 +292,7 @@ struct nsbuild : public neo::command_handler
     std::filesystem::path dl_dir;
     std::filesystem::path sdk_dir;
     std::filesystem::path rt_dir;
+    std::filesystem::path bincache_dir;
   };
 
   fullpaths paths;
@@ -251,4 +308,5 @@ struct nsbuild : public neo::command_handler
   inline std::filesystem::path const& get_full_out_dir() const { return paths.out_dir; }
   inline std::filesystem::path const& get_full_dl_dir() const { return paths.dl_dir; }
   inline std::filesystem::path const& get_full_sdk_dir() const { return paths.sdk_dir; }
+  inline std::filesystem::path const& get_full_bincache_dir() const { return paths.bincache_dir; }
 };
@@ -27,6 +27,9 @@ std::optional<std::string> get_filter(nspreset const& preset, nsfilters const&);
 void        value(std::string& result, neo::list::vector::const_iterator b, neo::list::vector::const_iterator e,
                   char seperator = ';');
 std::string value(nsparams const&, char seperator = ';');
+void        values(std::vector<std::string_view>& result, neo::list::vector::const_iterator b,
+                   neo::list::vector::const_iterator e);
+std::string value(std::vector<std::string_view> const&, char seperator = ';');
 std::string path(std::filesystem::path const&);
 std::string value(std::string val);
 void        line(std::ostream&, std::string_view name, char type = '-', bool header = false);
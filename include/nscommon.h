@@ -52,7 +52,18 @@ enum class runas
   generate_enum,
   copy_media,
   clean,
-  header_map
+  header_map,
+  watch
+};
+
+/// @brief How runtime files of the sdk are placed into the runtime directory
+enum class deploy_mode
+{
+  copy,
+  hardlink,
+  symlink,
+  // Shared libraries stay in the sdk and are found through the RPATH, only the other files are linked
+  rpath
 };
 
 enum class output_fmt
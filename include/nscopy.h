@@ -0,0 +1,30 @@
+#pragma once
+#include <filesystem>
+
+/// @brief File copies for deployment. A destination that already holds the same bytes is left alone, anything else
+/// is cloned (FICLONE reflink) where the filesystem shares extents and copied in the kernel (copy_file_range)
+/// otherwise.
+namespace nscopy
+{
+enum class result
+{
+  unchanged,
+  cloned,
+  copied,
+  linked
+};
+
+enum class link
+{
+  none,
+  hard,
+  symbolic
+};
+
+/// @brief Makes to a copy of from, replaced in one rename and stamped with the mtime of from. It is left untouched
+/// when its size and mtime, or its size and content, match from. Throws std::filesystem::filesystem_error.
+result file(std::filesystem::path const& from, std::filesystem::path const& to);
+/// @brief Places from at to as a link of the given kind. A copy (file) is made for link::none, or when the filesystem
+/// refuses the link. Whatever to was before, a file, a link to from or elsewhere, is replaced when it differs.
+result deploy(std::filesystem::path const& from, std::filesystem::path const& to, link kind);
+} // namespace nscopy
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// @brief Directory listings kept in the cache dir, keyed by path. A directory whose mtime and inode did not change
+/// since it was listed has the same entries, it is not read again. Globs then cost a stat per directory instead of
+/// reading every directory.
+class nsdircache
+{
+public:
+  struct entry
+  {
+    std::string name;
+    bool        is_dir = false;
+  };
+
+  /// @brief Loads the listings, a no-op when they were already loaded from this path
+  void load(std::filesystem::path const&);
+  /// @brief Writes back the listings used during this run, or all of them when prune is false
+  void save(std::filesystem::path const&, bool prune = true) const;
+
+  using entries = std::shared_ptr<std::vector<entry> const>;
+
+  /// @brief Entries of dir, from the cache when its stamp is unchanged. Thread safe, throws like directory_iterator.
+  entries list(std::filesystem::path const& dir);
+
+private:
+  struct stamp
+  {
+    std::int64_t  mtime_ns = 0;
+    std::uint64_t inode    = 0;
+
+    bool operator==(stamp const&) const = default;
+  };
+
+  struct listing
+  {
+    stamp   st;
+    entries content;
+    bool    used = false;
+  };
+
+  static bool get_stamp(std::filesystem::path const&, stamp&);
+
+  std::unordered_map<std::string, listing> dirs;
+  std::filesystem::path                    loaded;
+  std::mutex                               lock;
+  std::int64_t                             start_ns = 0;
+};
@@ -13,6 +13,8 @@ struct nsfetch
   std::string_view         repo;
   std::string_view         license;
   std::string_view         tag;
+  // Pins the fetch to a commit, the tag is ignored when it is set
+  std::string_view         commit;
   std::string_view         source;
   std::string              version;
   std::vector<nsvars>      args;
@@ -29,5 +31,7 @@ struct nsfetch
   bool                     force_build    = false;
   bool                     force_download = false;
   bool                     regenerate     = false;
+  // Sources were fetched before the module was processed
+  bool                     downloaded     = false;
   bool                     disabled       = false;
 };
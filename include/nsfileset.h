@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief File paths kept as a directory stored once plus a leaf name per file, all characters in one buffer.
+/// Sorting compares bytes with the separator ranked first, which orders them as std::filesystem::path does.
+class nsfileset
+{
+public:
+  static constexpr char separator = static_cast<char>(std::filesystem::path::preferred_separator);
+
+  /// @brief Stores a normal native directory path, files in it are added with the returned id
+  std::uint32_t add_dir(std::string_view dir);
+  void          add(std::uint32_t dir, std::string_view leaf);
+  /// @brief Adds every file of other
+  void          append(nsfileset const& other);
+  void          sort();
+
+  std::size_t size() const { return files.size(); }
+  bool        empty() const { return files.empty(); }
+  /// @brief Bytes held by the set
+  std::size_t memory() const;
+
+  /// @brief Calls l(dir, leaf) for every file, dir being the native directory path without a trailing separator
+  template <typename L>
+  void for_each(L&& l) const
+  {
+    for (auto const& f : files)
+      l(view(dirs[f.dir]), view(f.leaf));
+  }
+
+  /// @brief Calls l(prefix, leaf) for every file, prefix being the generic directory path relative to base with a
+  /// trailing '/', empty for files directly in base. The path is absolute when base is empty.
+  template <typename L>
+  void for_each_relative(std::filesystem::path const& base, L&& l) const
+  {
+    auto prefixes = relative_dirs(base);
+    for (auto const& f : files)
+      l(std::string_view{prefixes[f.dir]}, view(f.leaf));
+  }
+
+private:
+  struct range
+  {
+    std::uint32_t offset = 0;
+    std::uint32_t size   = 0;
+  };
+
+  struct file
+  {
+    std::uint32_t dir = 0;
+    range         leaf;
+  };
+
+  std::string_view         view(range r) const { return {buffer.data() + r.offset, r.size}; }
+  range                    store(std::string_view);
+  std::vector<std::string> relative_dirs(std::filesystem::path const& base) const;
+
+  std::string        buffer;
+  std::vector<range> dirs;
+  std::vector<file>  files;
+};
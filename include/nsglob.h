@@ -1,6 +1,8 @@
 #pragma once
 #include <filesystem>
 #include <nscommon.h>
+#include <nsdircache.h>
+#include <nsfileset.h>
 #include <string_view>
 #include <unordered_set>
 
@@ -12,8 +14,10 @@ struct nsglob
   std::string_view                 path_exclude_filters;
 
   std::vector<std::filesystem::path> sub_paths;
-  using file_set = std::vector<std::filesystem::path>;
+  using file_set = nsfileset;
   file_set files;
+  // Directories walked by accumulate
+  std::vector<std::filesystem::path> dirs;
 
   std::string sha;
   bool        recurse = false;
@@ -28,7 +32,9 @@ struct nsglob
 
   void print(std::ostream&, std::string_view) const;
   void print(std::ostream&, std::string_view as, std::string_view ctx, std::filesystem::path const& relative_to) const;
+  /// @brief Walks the sub paths into files and dirs, both sorted, and hashes the file list into sha
   void accumulate();
-  void process_entry(file_set&, std::filesystem::directory_entry const&);
-  void process_directory(file_set&, std::filesystem::directory_entry const&);
+  /// @brief accumulate for many globs at once, the directories of all of them are spread over one work-stealing pool.
+  /// Listings of unchanged directories come from cache when one is given.
+  static void accumulate(std::vector<nsglob*> const& globs, nsdircache* cache = nullptr);
 };
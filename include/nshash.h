@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/// @brief Hashing used by change detection.
+/// fast is a 64 bit non-cryptographic hash (wyhash), meant for comparing against a previously stored value.
+/// sha256 is used where a digest may be pinned or compared across machines, it runs on the SHA extensions
+/// when the CPU has them and falls back to picosha2 otherwise.
+namespace nshash
+{
+enum class algorithm
+{
+  fast,
+  sha256
+};
+
+std::uint64_t fast(std::string_view data, std::uint64_t seed = 0);
+/// @brief 16 character hex string of fast()
+std::string   fast_hex(std::string_view data);
+/// @brief 64 character hex string of the SHA-256 digest
+std::string   sha256_hex(std::string_view data);
+/// @brief True when sha256_hex uses the SHA extensions
+bool          has_sha_ni();
+
+inline std::string hex(std::string_view data, algorithm a = algorithm::fast)
+{
+  return a == algorithm::fast ? fast_hex(data) : sha256_hex(data);
+}
+} // namespace nshash
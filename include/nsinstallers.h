@@ -5,17 +5,29 @@
 #include <filesystem>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 struct nsinstallers
 {
   std::unordered_map<std::string, bool> uninstallers;
+  // Manifests of the fetches installed during this run
+  std::vector<std::string>              rebuilt;
 
-  void clear() { uninstallers.clear(); }
+  void clear()
+  {
+    uninstallers.clear();
+    rebuilt.clear();
+  }
 
   void save(std::filesystem::path const&) const;
   void load(std::filesystem::path const&);
 
   void uninstall_unused_and_save(std::filesystem::path const&) const;
   void installed(std::string entry) { uninstallers[entry] = true; }
+  void reinstalled(std::string entry)
+  {
+    rebuilt.push_back(entry);
+    installed(std::move(entry));
+  }
   void uninstall(std::string const& entry) const;
 };
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// @brief GNU make jobserver for the fetch builds. When nsbuild runs under a make or ninja that exports a jobserver
+/// in MAKEFLAGS it is a client of that one, otherwise it serves its own named pipe holding a token for every job
+/// but one. Nested builds find it through MAKEFLAGS (make 4.4 and Ninja 1.13 take their jobs from it), so the fetch
+/// builds and everything they run together stay within the job count. Only POSIX systems have a jobserver.
+class nsjobserver
+{
+public:
+  /// @brief A job taken from the jobserver, given back when destroyed. The first one is the job every process holds.
+  class slot
+  {
+  public:
+    slot() = default;
+    slot(slot&& other) noexcept : owner(std::exchange(other.owner, nullptr)), token(other.token) {}
+    slot& operator=(slot&&) = delete;
+    ~slot();
+
+  private:
+    friend class nsjobserver;
+    slot(nsjobserver* o, int t) : owner(o), token(t) {}
+
+    nsjobserver* owner = nullptr;
+    // The byte read from the pipe, -1 for the job of this process
+    int          token = -1;
+  };
+
+  /// @brief Joins the jobserver in MAKEFLAGS, or serves jobs tokens through a fifo created in dir
+  nsjobserver(std::filesystem::path const& dir, unsigned jobs);
+  ~nsjobserver();
+  nsjobserver(nsjobserver const&)            = delete;
+  nsjobserver& operator=(nsjobserver const&) = delete;
+
+  /// @brief Blocks until a job is free, an inactive jobserver hands out slots right away
+  slot acquire();
+  /// @brief Variables to set for child processes, empty when they inherit the jobserver from this process
+  std::vector<std::pair<std::string, std::string>> const& environment() const { return env; }
+  bool                                                    is_active() const { return read_fd >= 0; }
+
+private:
+  void release(int token);
+
+  int                                              read_fd  = -1;
+  int                                              write_fd = -1;
+  bool                                             owned    = false;
+  std::filesystem::path                            fifo;
+  std::mutex                                       lock;
+  bool                                             own_job_free = true;
+  // Threads blocked on the pipe, and tokens written for the job of this process while they were
+  unsigned                                         waiting      = 0;
+  unsigned                                         lent         = 0;
+  std::vector<std::pair<std::string, std::string>> env;
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class nsstatedb;
+
+/// @brief Dirty-path journal written by `nsbuild --watch` into the cache dir.
+/// The first line names the watcher session, every following line is a changed path and `*` marks a lost event.
+/// A check reads the lines appended since the position it committed last time, the journal is only trusted while
+/// the watcher that writes it is alive (it holds a lock on the file) and no event was lost. Before reading, a check
+/// creates a cookie file in a watched dir and waits for the watcher to journal it, every change made before the check
+/// started is then in the journal too.
+class nsjournal
+{
+public:
+  static constexpr std::string_view k_header   = "nsjournal 1 ";
+  static constexpr std::string_view k_overflow = "*";
+  static constexpr std::string_view k_cookie   = ".nsbuild-cookie-";
+
+  /// @brief Reads the entries that are newer than the position committed in db. watched is a dir the watcher
+  /// follows, the journal is not trusted when the watcher does not report a cookie created in it in time.
+  void load(std::filesystem::path const& file, nsstatedb const& db, std::filesystem::path const& watched);
+  /// @brief Records the position read by load, call once the check has written its state
+  void commit(nsstatedb& db) const;
+
+  /// @brief True when the entries cover every change since the last check
+  bool is_valid() const { return valid; }
+  /// @brief True when dir, anything below it or one of its parents was changed
+  bool touched(std::filesystem::path const& dir) const;
+
+private:
+  std::vector<std::string> paths;
+  std::string              session;
+  std::uint64_t            end   = 0;
+  bool                     valid = false;
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string_view>
+#include <vector>
+
+/// @brief A regular expression compiled once into a DFA, for patterns run against many file names. The syntax is the
+/// ECMAScript one restricted to literals, escapes (\d \w \s, their negations and escaped characters), '.', bracket
+/// classes, groups, '|', the * + ? {m,n} quantifiers and the ^ $ anchors. Anything else (backreferences, lookarounds,
+/// \b) is handed to std::regex, so every pattern std::regex accepts still works. The DFA only answers whether a name
+/// matches, the extent of a match is always the one std::regex gives.
+class nsmatcher
+{
+public:
+  nsmatcher() = default;
+  /// @brief Throws std::regex_error for patterns std::regex rejects too
+  explicit nsmatcher(std::string_view pattern, bool icase = false);
+
+  /// @brief True when the pattern matches anywhere in s, as std::regex_search
+  bool search(std::string_view s) const { return search(s, 0); }
+  /// @brief The match std::regex_search finds in s from the position from on, leftmost and with ECMAScript priority
+  /// (lazy quantifiers, first alternative). Names the DFA rejects never reach std::regex.
+  bool find(std::string_view s, std::size_t& start, std::size_t& length, std::size_t from = 0) const;
+  /// @brief False when std::regex runs the pattern
+  bool is_compiled() const { return !fallback; }
+
+private:
+  /// @brief State 0 is the dead state, symbols are the byte values and the end of input
+  struct automaton
+  {
+    std::vector<std::array<std::uint32_t, 257>> next;
+    std::vector<bool>                           accept;
+    std::uint32_t                               start_at_begin = 0;
+    std::uint32_t                               start          = 0;
+  };
+
+  struct lazy_regex;
+
+  bool search(std::string_view s, std::size_t from) const;
+
+  automaton                   searcher;
+  std::shared_ptr<std::regex> fallback;
+  // Compiled on the first find, most matchers only ever search
+  std::shared_ptr<lazy_regex> extent;
+};
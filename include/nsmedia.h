@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/// @brief Files of a module's media directory, written by the check from the data_group glob and read by
+/// --copy-media. Deploying diffs it against the manifest of the last deploy, neither directory is walked.
+struct nsmedia_manifest
+{
+  struct entry
+  {
+    /// Generic path relative to the media directory
+    std::string   path;
+    std::uint64_t size     = 0;
+    std::int64_t  mtime_ns = 0;
+    std::uint64_t hash     = 0;
+
+    bool same_content(entry const& o) const { return size == o.size && hash == o.hash; }
+  };
+
+  /// @brief Sorted by path
+  std::vector<entry> entries;
+  /// @brief Inode of the directory the entries were deployed to, only set in the record of a deploy
+  std::uint64_t      target = 0;
+
+  /// @brief False when the file is missing or not a manifest, entries are then empty
+  bool read(std::filesystem::path const&);
+  /// @brief Writes the manifest unless the file already holds it, entries are sorted first. False when the file
+  /// could not be written.
+  bool write(std::filesystem::path const&);
+};
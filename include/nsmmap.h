@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+/// @brief Read-only memory mapping of a whole file. Empty files map to an empty view.
+class nsmapped_file
+{
+public:
+  nsmapped_file() = default;
+  explicit nsmapped_file(std::filesystem::path const& path) { open(path); }
+  ~nsmapped_file() { close(); }
+
+  nsmapped_file(nsmapped_file&& other) noexcept { swap(other); }
+  nsmapped_file& operator=(nsmapped_file&& other) noexcept
+  {
+    if (this != &other)
+    {
+      close();
+      swap(other);
+    }
+    return *this;
+  }
+  nsmapped_file(nsmapped_file const&)            = delete;
+  nsmapped_file& operator=(nsmapped_file const&) = delete;
+
+  bool open(std::filesystem::path const&);
+  void close();
+
+  bool             is_open() const { return opened; }
+  std::string_view view() const { return {static_cast<char const*>(data), size}; }
+
+private:
+  void swap(nsmapped_file& other) noexcept;
+
+  void const* data   = nullptr;
+  std::size_t size   = 0;
+  bool        opened = false;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+  void* file    = nullptr;
+  void* mapping = nullptr;
+#endif
+};
+
+/// @brief Text of small files read into a few large chunks, for sources that are parsed once and referenced by view
+/// for as long as the arena lives. Unlike a mapping the text does not change or fault when the file is rewritten
+/// while it is in use, and every view is followed by a terminating zero. Thread safe.
+class nsfile_arena
+{
+public:
+  /// @brief Reads the whole file, text views it until the arena is destroyed. False when it cannot be read.
+  bool read(std::filesystem::path const& path, std::string_view& text);
+  /// @brief Gives back the space of text when nothing was read after it, it must not be used any more
+  void pop(std::string_view text);
+
+private:
+  static constexpr std::size_t k_chunk = 256 * 1024;
+
+  struct chunk
+  {
+    std::unique_ptr<char[]> data;
+    std::size_t             capacity = 0;
+    std::size_t             used     = 0;
+  };
+
+  char* reserve(std::size_t size);
+
+  std::vector<chunk> chunks;
+  std::mutex         lock;
+};
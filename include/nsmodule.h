@@ -34,10 +34,27 @@ struct nscontent
 
 struct ns_embed_content
 {
-  std::string hpp;
-  std::string cpp;
+  struct entry
+  {
+    std::string           name;
+    std::string           value;
+    std::filesystem::path file;
+  };
+
+  /// @brief Generated resource declarations and definitions
+  struct generated
+  {
+    std::string hpp;
+    std::string cpp;
+
+    void emplace_back(std::string_view name, std::string_view value, std::string content);
+  };
 
-  void emplace_back(std::string_view name, std::string_view value, std::string content);
+  /// @brief Files are recorded at parse time and only read when resources are regenerated
+  std::vector<entry> files;
+
+  void emplace_back(std::string_view name, std::string_view value, std::filesystem::path file);
+  void generate(generated&) const;
 };
 
 /// @brief These targets are defined by every module
@@ -103,11 +120,22 @@ struct nsmodule
   bool deleted      = false;
   bool sha_written  = false;
 
+  struct fetch_build
+  {
+    std::size_t index;
+    std::string sha;
+  };
+  // Fetches to rebuild, built once the fetches of the modules this one depends on are installed
+  std::vector<fetch_build> fetch_builds;
+
   // .. Options
   bool console_app         = false;
   bool was_fetch_rebuilt   = false;
   bool has_globs_changed   = false;
   bool has_headers_changed = false;
+  // Not changed since the last check according to the watch journal
+  bool unchanged      = false;
+  bool globs_deferred = false;
 
   nsmodule()                               = default;
   nsmodule(nsmodule&&) noexcept            = default;
@@ -158,15 +186,31 @@ struct nsmodule
   void update_properties(nsbuild const& bc, std::string const& targ_name, nstarget& targ);
   void update_macros(nsbuild const& bc, std::string const& targ_name, nstarget& targ);
   void update_fetch(nsbuild const& bc, nsinstallers& installer);
+  /// @brief Marks the fetches that are regenerated, before any module is processed
+  void update_fetch_state(nsbuild const& bc);
+  /// @brief True when the sources of ft have to be downloaded
+  bool needs_download(nsbuild const& bc, nsfetch const& ft) const;
+  /// @brief Downloads the sources of ft ahead of processing, safe to run for several fetches at once
+  void prefetch(nsbuild const& bc, nsfetch& ft) const;
   void gather_sources(nsglob& glob, nsbuild const& bc) const;
   void gather_headers(nsglob& glob, nsbuild const& bc) const;
   void check_enums(nsbuild const& bc) const;
   void check_embeds(nsbuild const& bc) const;
   void write_sha(nsbuild const& bc);
+  /// @brief Adds the media and source globs still to be walked
+  void pending_globs(nsbuild const& bc, std::vector<nsglob*>& globs);
+  /// @brief Compares the walked globs with the last check
+  void update_glob_shas(nsbuild const& bc);
+  /// @brief Writes media.manifest from the data_group glob for --copy-media
+  void write_media_manifest(nsbuild const& bc) const;
+  /// @brief False when the module can keep its glob digests from the last check
+  bool globs_needed() const { return !unchanged || regenerate || force_build; }
 
   content make_fetch_build_content(nsbuild const& bc, nsfetch const& ft) const;
   void    write_fetch_build_content(nsbuild const& bc, nsfetch const& ft, content const&) const;
   void    fetch_content(nsbuild const& bc, nsinstallers& installer, nsfetch& ft);
+  /// @brief Builds and installs the fetches fetch_content queued, runs for several modules at once
+  void    build_fetches(nsbuild const& bc, nsinstallers& installer);
   bool    fetch_changed(nsbuild const& bc, nsfetch const& ft, std::string const& last_sha) const;
   void    write_fetch_meta(nsbuild const& bc, nsfetch const& ft, std::string const& last_sha) const;
   /// @brief Called to write the cmake file
@@ -222,8 +266,16 @@ struct nsmodule
   void write_runtime_settings(std::ostream&, nsbuild const& bc) const;
 
   void build_fetched_content(nsbuild const& bc, nsinstallers& installer, nsfetch const& fetch);
+  /// @brief What the configure of a fetch depends on: compiler, generator, args and the generated build files
+  std::string fetch_build_inputs(nsbuild const& bc, nsfetch const& ft) const;
+  /// @brief Binary cache key of a fetch: its generated build files, source, args and compiler, and the same for every
+  /// fetch it may build against
+  std::string fetch_cache_key(nsbuild const& bc, nsfetch const& ft) const;
+  /// @brief Changes when the fetch build dir has to be configured again, it adds cmake and the toolchain file
+  std::string fetch_configure_key(nsbuild const& bc, nsfetch const& ft) const;
   void delete_build(nsbuild const& bc);
   bool download(nsbuild const& bc, nsfetch& ft);
+  void download_source(nsbuild const& bc, nsfetch const& ft) const;
 
   bool sha_changed(nsbuild const& bc, std::string_view name, std::string_view sha) const;
   void write_sha_changed(nsbuild const& bc, std::string_view name, std::string_view sha) const;
@@ -237,5 +289,4 @@ struct nsmodule
   std::filesystem::path get_full_sdk_dir(nsbuild const& bc) const;
   std::filesystem::path get_full_dl_dir(nsbuild const& bc, nsfetch const& nfc) const;
   std::filesystem::path get_full_gen_dir(nsbuild const& bc) const;
-  std::filesystem::path get_full_fetch_file(nsbuild const& bc, nsfetch const& nfc) const;
 };
@@ -0,0 +1,343 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace nsparallel
+{
+
+inline unsigned hardware_jobs()
+{
+  auto n = std::thread::hardware_concurrency();
+  return n ? n : 1;
+}
+
+/// @brief Calls l(i) for every i in [0, count) using up to jobs threads, the calling thread included.
+/// Items are picked in index order. Once an item throws no new items are started, and the exception
+/// with the lowest index is rethrown after every worker has returned.
+template <typename L>
+void for_each(std::size_t count, unsigned jobs, L&& l)
+{
+  if (!count)
+    return;
+  if (!jobs)
+    jobs = hardware_jobs();
+  jobs = static_cast<unsigned>(std::min<std::size_t>(jobs, count));
+
+  std::atomic<std::size_t>        next   = 0;
+  std::atomic<bool>               failed = false;
+  std::vector<std::exception_ptr> errors(count);
+
+  auto worker = [&]()
+  {
+    while (!failed.load(std::memory_order_relaxed))
+    {
+      auto i = next.fetch_add(1, std::memory_order_relaxed);
+      if (i >= count)
+        break;
+      try
+      {
+        l(i);
+      }
+      catch (...)
+      {
+        errors[i] = std::current_exception();
+        failed    = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(jobs - 1);
+  for (unsigned t = 1; t < jobs; ++t)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads)
+    t.join();
+
+  if (failed)
+  {
+    for (auto const& e : errors)
+      if (e)
+        std::rethrow_exception(e);
+  }
+}
+
+template <typename L>
+void for_each(std::size_t count, L&& l)
+{
+  for_each(count, hardware_jobs(), std::forward<L>(l));
+}
+
+/// @brief Calls l(i) for every node of a dependency graph using up to jobs threads, the calling thread included.
+/// Node i starts once every node listed in dependencies[i] has returned, the graph must not have cycles. Ready nodes
+/// are picked in the order they became ready and idle threads sleep until one is. Once a node throws no new nodes
+/// are started, the first exception is rethrown after the running ones have returned.
+template <typename L>
+void for_each_ordered(std::vector<std::vector<std::size_t>> const& dependencies, unsigned jobs, L&& l)
+{
+  auto count = dependencies.size();
+  if (!count)
+    return;
+  if (!jobs)
+    jobs = hardware_jobs();
+  jobs = static_cast<unsigned>(std::min<std::size_t>(jobs, count));
+
+  std::vector<std::size_t>              waiting(count);
+  std::vector<std::vector<std::size_t>> dependents(count);
+  std::deque<std::size_t>               ready;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    waiting[i] = dependencies[i].size();
+    for (auto d : dependencies[i])
+      dependents[d].push_back(i);
+    if (!waiting[i])
+      ready.push_back(i);
+  }
+
+  std::mutex              lock;
+  std::condition_variable wake;
+  std::size_t             done   = 0;
+  bool                    failed = false;
+  std::exception_ptr      error;
+
+  auto worker = [&]()
+  {
+    std::unique_lock guard{lock};
+    while (true)
+    {
+      wake.wait(guard, [&] { return !ready.empty() || failed || done == count; });
+      if (failed || done == count)
+        break;
+      auto i = ready.front();
+      ready.pop_front();
+
+      guard.unlock();
+      std::exception_ptr e;
+      try
+      {
+        l(i);
+      }
+      catch (...)
+      {
+        e = std::current_exception();
+      }
+      guard.lock();
+
+      ++done;
+      if (e)
+      {
+        if (!error)
+          error = e;
+        failed = true;
+      }
+      else
+      {
+        for (auto d : dependents[i])
+          if (!--waiting[d])
+            ready.push_back(d);
+      }
+      wake.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(jobs - 1);
+  for (unsigned t = 1; t < jobs; ++t)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads)
+    t.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+/// @brief Runs tasks that spawn more tasks (a directory walk) on up to jobs threads, the calling thread included.
+/// Every worker owns a deque, it pushes and pops its newest tasks at the back and, once it runs dry, steals the
+/// oldest task at the front of another worker's deque. Idle workers sleep until a task is pushed. Only as many
+/// workers as there are queued tasks are started, more are added while tasks push work that nobody is free to take.
+/// After a task throws no new tasks are started and the first exception is rethrown once every worker has returned.
+template <typename Task>
+class work_stealing
+{
+public:
+  /// @brief Handed to the task function, push queues a task on the current worker
+  class worker
+  {
+  public:
+    void     push(Task t) { pool.push(id, std::move(t)); }
+    unsigned index() const { return id; }
+
+  private:
+    friend class work_stealing;
+    worker(work_stealing& p, unsigned i) : pool(p), id(i) {}
+
+    work_stealing& pool;
+    unsigned       id;
+  };
+
+  explicit work_stealing(unsigned jobs = 0) : queues(jobs ? jobs : hardware_jobs()) {}
+
+  unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+  /// @brief Queues a task before run, tasks are dealt to the workers in turn
+  void push(Task t) { push(static_cast<unsigned>(seeded++ % queues.size()), std::move(t)); }
+
+  /// @brief Calls l(task, worker&) until no task is left
+  template <typename L>
+  void run(L&& l)
+  {
+    if (!pending)
+      return;
+
+    std::exception_ptr error;
+    std::mutex         error_lock;
+
+    work = [&](unsigned id)
+    {
+      worker self{*this, id};
+      while (!failed)
+      {
+        Task task;
+        if (!pop(id, task))
+        {
+          std::unique_lock guard{idle_lock};
+          ++sleeping;
+          wake.wait(guard, [this] { return queued > 0 || !pending || failed; });
+          --sleeping;
+          if (!pending || failed)
+            break;
+          continue;
+        }
+        try
+        {
+          l(std::move(task), self);
+        }
+        catch (...)
+        {
+          {
+            std::scoped_lock guard{error_lock};
+            if (!error)
+              error = std::current_exception();
+          }
+          std::scoped_lock guard{idle_lock};
+          failed = true;
+          wake.notify_all();
+        }
+        if (pending.fetch_sub(1) == 1)
+        {
+          std::scoped_lock guard{idle_lock};
+          wake.notify_all();
+        }
+      }
+    };
+
+    started = static_cast<unsigned>(std::min<std::size_t>(seeded ? seeded : 1, queues.size()));
+    for (unsigned t = 1; t < started; ++t)
+      threads.emplace_back(work, t);
+    work(0);
+    // Workers may still be adding workers until they have returned
+    for (std::size_t t = 0;; ++t)
+    {
+      std::thread joining;
+      {
+        std::scoped_lock guard{idle_lock};
+        if (t == threads.size())
+          break;
+        joining = std::move(threads[t]);
+      }
+      joining.join();
+    }
+
+    threads.clear();
+    for (auto& q : queues)
+      q.tasks.clear();
+    work    = {};
+    pending = 0;
+    queued  = 0;
+    seeded  = 0;
+    failed  = false;
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+private:
+  struct queue
+  {
+    std::mutex       lock;
+    std::deque<Task> tasks;
+  };
+
+  void push(unsigned id, Task t)
+  {
+    // Counted before it is visible so that pending never drops to zero while work is queued
+    pending.fetch_add(1);
+    {
+      std::scoped_lock guard{queues[id].lock};
+      queues[id].tasks.emplace_back(std::move(t));
+    }
+    queued.fetch_add(1);
+    // Seen by a worker going to sleep, or the worker is already asleep and gets woken
+    if (!work || (sleeping == 0 && started == queues.size()))
+      return;
+    std::scoped_lock guard{idle_lock};
+    if (sleeping)
+      wake.notify_one();
+    else if (started < queues.size() && !failed)
+      threads.emplace_back(work, started++);
+  }
+
+  bool pop(unsigned id, Task& t)
+  {
+    {
+      auto&            own = queues[id];
+      std::scoped_lock guard{own.lock};
+      if (!own.tasks.empty())
+      {
+        t = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        queued.fetch_sub(1);
+        return true;
+      }
+    }
+    for (std::size_t i = 1; i < queues.size(); ++i)
+    {
+      auto&            victim = queues[(id + i) % queues.size()];
+      std::scoped_lock guard{victim.lock};
+      if (!victim.tasks.empty())
+      {
+        t = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        queued.fetch_sub(1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<queue>       queues;
+  std::atomic<std::size_t> pending = 0;
+  // Tasks sitting in a deque, not yet taken by a worker
+  std::atomic<std::size_t> queued = 0;
+  std::size_t              seeded = 0;
+
+  // Set while run is active, idle_lock guards waking, adding and joining workers
+  std::function<void(unsigned)> work;
+  std::vector<std::thread>      threads;
+  std::mutex                    idle_lock;
+  std::condition_variable       wake;
+  std::atomic<unsigned>         sleeping = 0;
+  std::atomic<unsigned>         started  = 0;
+  std::atomic<bool>             failed   = false;
+};
+
+} // namespace nsparallel
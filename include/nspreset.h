@@ -40,6 +40,8 @@ struct nspreset
   bool unity_build    = false;
   bool glob_sources   = false;
 
+  deploy_mode runtime_deploy = deploy_mode::copy;
+
   std::string cppcheck_suppression;
 
   static void write(std::ostream&, std::uint32_t options, nameval_list const& extras, nsbuild const&);
@@ -18,7 +18,9 @@ void powershell(nsbuild const& bc, std::vector<std::string> args, std::filesyste
 
 bool download(nsbuild const& bc, std::filesystem::path const& dl, std::string_view const& repo, std::string_view name,
               std::string_view version, bool force);
-void git_clone(nsbuild const& bc, std::filesystem::path const& dl, std::string_view const& repo, std::string_view tag);
+/// @brief Checks out commit, or tag when there is no commit, of repo in dl, only the source directory when it is set
+void git_clone(nsbuild const& bc, std::filesystem::path const& dl, std::string_view const& repo, std::string_view tag,
+               std::string_view commit, std::string_view source);
 
 std::filesystem::path        get_nsbuild_path();
 extern std::filesystem::path s_nsbuild;
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+/// @brief Chrome trace-event profile of a run (--profile=<file>), it opens in chrome://tracing or ui.perfetto.dev.
+/// Spans nest per thread, each one reports the bytes read and the files touched while it was open, nested spans
+/// included. Recording is off by default and a span then costs a relaxed atomic load.
+namespace nsprofile
+{
+/// @brief Starts recording, the trace is written by finish
+void start(std::filesystem::path file);
+/// @brief Writes the trace, if recording, and stops
+void finish();
+bool enabled();
+
+/// @brief Accounts files that were stat'ed or read to the innermost span of the calling thread
+void touch(std::uint64_t bytes_read = 0, std::uint64_t files = 1);
+
+/// @brief Records its lifetime as a span
+class span
+{
+public:
+  explicit span(std::string_view name, std::string_view detail = {});
+  span(std::string_view name, std::string const& detail) : span(name, std::string_view(detail)) {}
+  span(std::string_view name, std::filesystem::path const& detail);
+  ~span();
+
+  span(span const&)            = delete;
+  span& operator=(span const&) = delete;
+
+private:
+  friend void touch(std::uint64_t, std::uint64_t);
+
+  void begin(std::string_view name);
+
+  span*         parent = nullptr;
+  std::string   name;
+  std::string   detail;
+  std::int64_t  start_us = 0;
+  std::uint64_t bytes    = 0;
+  std::uint64_t files    = 0;
+  bool          active   = false;
+};
+
+/// @brief Calls finish when it goes out of scope, so the trace is written however the run ends
+struct session
+{
+  session() = default;
+  ~session() { finish(); }
+  session(session const&)            = delete;
+  session& operator=(session const&) = delete;
+};
+} // namespace nsprofile
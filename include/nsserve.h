@@ -0,0 +1,19 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+
+/// @brief Resident nsbuild: `nsbuild --serve` keeps hashes, the state store and the list of inputs of the last
+/// check in memory, and answers `nsbuild --check` over a local socket. When no input changed since the last
+/// successful check the answer is immediate, otherwise the check runs inside the daemon with warm caches.
+namespace nsserve
+{
+/// @brief Socket the daemon for a source directory listens on
+std::filesystem::path socket_path(std::filesystem::path const& source);
+
+/// @brief Runs the daemon for source until it is interrupted
+int serve(std::filesystem::path const& source);
+
+/// @brief Forwards a check to the daemon, output is streamed to stdout.
+/// Returns the exit code of the check, or nullopt when no daemon answered so the caller runs it locally.
+std::optional<int> request(std::filesystem::path const& source, int argc, char const* argv[]);
+} // namespace nsserve
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <nsmmap.h>
+#include <string>
+#include <string_view>
+
+struct nsmodule;
+
+/// @brief Binary snapshot of a parsed module, lets an unchanged Module.ns skip neoscript entirely.
+/// String views in a loaded module point into the mapped snapshot, which is kept alive in contents.
+namespace nssnapshot
+{
+/// @brief Bump whenever parse-time state is added to nsmodule
+static inline constexpr std::uint32_t k_version = 3;
+
+bool load(nsmodule&, std::filesystem::path const& file, std::string_view key, std::list<nsmapped_file>& contents);
+void save(nsmodule const&, std::filesystem::path const& file, std::string_view key);
+} // namespace nssnapshot
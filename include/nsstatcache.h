@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/// @brief Manifest of (path, size, mtime_ns, inode) -> content digest, kept in the cache dir.
+/// Files whose stat data has not changed since the last run reuse their stored digest and are never opened.
+struct nsstatcache
+{
+  struct stamp
+  {
+    std::uint64_t size     = 0;
+    std::int64_t  mtime_ns = 0;
+    std::uint64_t inode    = 0;
+
+    bool operator==(stamp const&) const = default;
+  };
+
+  struct entry
+  {
+    stamp       st;
+    std::string digest;
+    bool        used = false;
+  };
+
+  /// @brief Loads the manifest, a no-op when it was already loaded from this path
+  void load(std::filesystem::path const&);
+  /// @brief Writes back the entries queried during this run, or all of them when prune is false
+  void save(std::filesystem::path const&, bool prune = true) const;
+
+  /// @brief Calls l(path) for every file queried so far
+  template <typename L>
+  void for_each_used(L&& l) const
+  {
+    for (auto const& e : entries)
+      if (e.second.used)
+        l(e.first);
+  }
+
+  /// @brief Content digest (nshash::fast_hex) of a file, empty if the file does not exist or cannot be read.
+  /// Thread safe, the file is only hashed when its stat data differs from the manifest.
+  std::string digest(std::filesystem::path const&);
+
+  static bool get_stamp(std::filesystem::path const&, stamp&);
+
+private:
+  std::unordered_map<std::string, entry> entries;
+  std::filesystem::path                  loaded;
+  std::mutex                             lock;
+  std::int64_t                           start_ns = 0;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <filesystem>
+#include <list>
+#include <nsmmap.h>
+#include <nsstatcache.h>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/// @brief Key -> digest store for everything the check remembers between runs (module, glob and fetch hashes).
+/// The file is a header followed by checksummed records, later records override earlier ones. It is memory
+/// mapped on open, writes are buffered and appended in one go on flush. A torn tail from a crash fails its
+/// checksum and is dropped. When dead records outweigh live ones the file is compacted into a new file and
+/// renamed over the old one. Other processes may write the same file, its stat data is remembered after every load
+/// and flush and the file is read again when it changed.
+class nsstatedb
+{
+public:
+  nsstatedb() = default;
+  ~nsstatedb();
+  nsstatedb(nsstatedb const&)            = delete;
+  nsstatedb& operator=(nsstatedb const&) = delete;
+
+  /// @brief Opens the store, importing the legacy *.sha, *.glob and *.fetch files next to it when it does not exist.
+  /// Opening the path that is already open keeps the in-memory state unless the file was changed by someone else.
+  void open(std::filesystem::path const& file);
+  void flush();
+
+  bool is_open() const { return !file.empty(); }
+  /// @brief Returns true when key is stored with exactly this value
+  bool matches(std::string_view key, std::string_view value) const;
+  bool get(std::string_view key, std::string& value) const;
+  void put(std::string_view key, std::string_view value);
+  void erase(std::string_view key);
+  void erase_prefix(std::string_view prefix);
+
+private:
+  void        load();
+  void        index(std::string_view data);
+  std::size_t apply(std::string_view data, std::size_t pos);
+  bool        changed() const;
+  void append(std::string_view key, std::string_view value, bool erased);
+  void import_legacy();
+  void compact();
+
+  std::filesystem::path file;
+  nsmapped_file         mapped;
+  // Values point into the mapping or into owned
+  std::unordered_map<std::string_view, std::string_view> values;
+  std::list<std::string>                                 owned;
+  std::string                                            pending;
+  std::list<std::filesystem::path>                       legacy;
+  // Stat data of the file as last read or written by this instance
+  nsstatcache::stamp                                     disk;
+  std::size_t                                            file_bytes = 0;
+  bool                                                   rewrite    = false;
+  mutable std::shared_mutex                              lock;
+};
@@ -4,8 +4,8 @@
 using nsparams = neo::command::parameters;
 struct nsnamed_params
 {
-  std::string_view name;
-  nsparams         params;
+  std::string_view              name;
+  std::vector<std::string_view> values;
 };
 
 enum class nspath_type
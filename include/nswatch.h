@@ -0,0 +1,11 @@
+#pragma once
+
+struct nsbuild;
+
+/// @brief `nsbuild --watch` follows the Frameworks and download dirs with inotify and appends every changed path to
+/// the journal (nsjournal) in the cache dir of each preset. A check then only re-scans the modules that appear in it.
+namespace nswatch
+{
+/// @brief Runs the watcher until it is interrupted, bc must have read Build.ns
+int watch(nsbuild& bc);
+} // namespace nswatch
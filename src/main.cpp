@@ -3,6 +3,9 @@
 #include <neo_script.hpp>
 #include <nsbuild.h>
 #include <nsprocess.h>
+#include <nsprofile.h>
+#include <nsserve.h>
+#include <nswatch.h>
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
 #define NS_DLL_EXT "(\\.dll$)|(\\.json$)|(\\.conf)"
 #include <Windows.h>
@@ -67,6 +70,8 @@ nscmakeinfo read_config(char const* argv[], int i, int argc)
   return cfg;
 }
 
+int nsbuild_main(nsbuild& build, int argc, char const* argv[]);
+
 void halt()
 {
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
@@ -82,21 +87,58 @@ int main(int argc, char const* argv[])
 #ifndef NDEBUG
   halt();
 #endif
+  nsprocess::s_nsbuild = std::filesystem::absolute(argv[0]);
+
+  std::string working_dir = ".";
+  bool        serve       = false;
+  bool        check       = false;
+  bool        use_daemon  = true;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string_view arg = argv[i];
+    if (arg == "--serve")
+      serve = true;
+    else if (arg == "--check")
+      check = true;
+    // A profile traces a check run by this process
+    else if (arg == "--no-serve" || arg.starts_with("--profile="))
+      use_daemon = false;
+    else if ((arg == "--source" || arg == "-s") && i + 1 < argc)
+      working_dir = argv[++i];
+  }
+
+  if (serve)
+    return nsserve::serve(working_dir);
+  // A resident nsbuild --serve answers the check when one is running for this source dir
+  if (check && use_daemon)
+  {
+    if (auto code = nsserve::request(working_dir, argc, argv))
+      return *code;
+  }
+
+  nsbuild build;
+  return nsbuild_main(build, argc, argv);
+}
 
+int nsbuild_main(nsbuild& build, int argc, char const* argv[])
+{
   std::string working_dir = ".";
   std::string target      = "";
   std::string preset      = "";
   std::string filepfx     = "";
   std::string apipfx      = "";
   nscmakeinfo nscfg;
-  runas       ras      = runas::main;
-  nsprocess::s_nsbuild = std::filesystem::absolute(argv[0]);
-  nsbuild build;
+  runas       ras = runas::main;
+  // Writes the trace requested with --profile when the run ends
+  nsprofile::session profile;
 
   for (int i = 1; i < argc; ++i)
   {
     std::string_view arg = argv[i];
 
+    if (arg.starts_with("--profile="))
+      nsprofile::start(arg.substr(std::string_view("--profile=").size()));
+
     if (arg == "--check" || arg == "-c")
     {
       ras   = runas::check;
@@ -119,6 +161,8 @@ int main(int argc, char const* argv[])
         working_dir = argv[i + 1];
       i++;
     }
+    else if (arg == "--watch" || arg == "-w")
+      ras = runas::watch;
     else if (arg == "--header-map" || arg == "-m")
     {
       ras = runas::header_map;
@@ -127,20 +171,28 @@ int main(int argc, char const* argv[])
     }
     else if (arg == "--copy-media" || arg == "-e")
     {
-      std::string from   = "";
-      std::string to     = "";
-      std::string artef  = "";
-      std::string ignore = "";
-      ras                = runas::copy_media;
+      std::string from     = "";
+      std::string to       = "";
+      std::string manifest = "";
+      std::string deployed = "";
+      ras                  = runas::copy_media;
       if (i + 1 < argc)
         from = argv[++i];
       if (i + 1 < argc)
         to = argv[++i];
       if (i + 1 < argc)
-        artef = argv[++i];
+        manifest = argv[++i];
       if (i + 1 < argc)
-        ignore = argv[++i];
-      nsbuild::copy_media(from, to, artef, ignore);
+        deployed = argv[++i];
+      try
+      {
+        nsbuild::copy_media(from, to, manifest, deployed);
+      }
+      catch (std::exception const& ex)
+      {
+        nslog::error(ex.what());
+        return -1;
+      }
       std::cout << std::endl;
       return 0;
     }
@@ -182,13 +234,15 @@ int main(int argc, char const* argv[])
       build.main_project();
       break;
     case runas::check:
-      build.dll_ext = std::regex(NS_DLL_EXT, std::regex_constants::icase);
+      build.dll_ext = nsmatcher(NS_DLL_EXT, true);
       build.before_all();
       break;
     case runas::clean:
-      build.dll_ext = std::regex(NS_DLL_EXT, std::regex_constants::icase);
+      build.dll_ext = nsmatcher(NS_DLL_EXT, true);
       build.clean_install();
       break;
+    case runas::watch:
+      return nswatch::watch(build);
     }
   }
   catch (module_regenerated ex)
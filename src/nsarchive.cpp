@@ -0,0 +1,815 @@
+#include "nsarchive.h"
+
+#include "nslog.h"
+#include "nsmmap.h"
+#include "nsprofile.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fmt/format.h>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#ifdef NSBUILD_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef NSBUILD_HAS_LZMA
+#include <lzma.h>
+#endif
+#ifdef NSBUILD_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace nsarchive
+{
+namespace
+{
+namespace fs = std::filesystem;
+
+constexpr std::size_t k_chunk = 256 * 1024;
+
+enum class format
+{
+  unknown,
+  zip,
+  tar,
+  gzip,
+  xz,
+  zstd
+};
+
+format detect(fs::path const& archive)
+{
+  std::array<char, 512> head{};
+  std::ifstream         in{archive, std::ios::binary};
+  in.read(head.data(), head.size());
+  std::string_view data{head.data(), static_cast<std::size_t>(in.gcount())};
+  if (data.starts_with("PK\x03\x04") || data.starts_with("PK\x05\x06"))
+    return format::zip;
+  if (data.starts_with("\x1f\x8b"))
+    return format::gzip;
+  if (data.starts_with(std::string_view{"\xfd" "7zXZ\0", 6}))
+    return format::xz;
+  if (data.starts_with("\x28\xb5\x2f\xfd"))
+    return format::zstd;
+  if (data.size() == 512 && data.substr(257, 5) == "ustar")
+    return format::tar;
+  return format::unknown;
+}
+
+[[noreturn]] void damaged(fs::path const& archive, std::string_view what)
+{
+  throw std::runtime_error(fmt::format("{} is damaged: {}", archive.generic_string(), what));
+}
+
+/// @brief The entries to write, all of them when it is empty
+struct selection
+{
+  std::vector<std::string> names;
+
+  explicit selection(std::vector<std::string> const& only)
+  {
+    for (auto const& n : only)
+      names.emplace_back(fs::path(n).lexically_normal().generic_string());
+  }
+
+  bool all() const { return names.empty(); }
+  bool contains(fs::path const& relative) const
+  {
+    return all() || std::ranges::find(names, relative.generic_string()) != names.end();
+  }
+};
+
+/// @brief Entry paths are relative to dest, absolute paths and .. are refused
+fs::path relative_path(std::string_view name)
+{
+  auto relative = fs::path(name).lexically_normal();
+  if (relative.has_root_name() || relative.has_root_directory() ||
+      (!relative.empty() && *relative.begin() == ".."))
+    throw std::runtime_error(fmt::format("Archive entry {} is outside the destination", name));
+  return relative;
+}
+
+/// @brief Writes the entries, links are made last so no entry is ever written through one
+class writer
+{
+public:
+  writer(fs::path d, std::vector<std::string> const& only) : dest(std::move(d)), selected(only) {}
+
+  bool wants(fs::path const& relative) const { return selected.contains(relative); }
+  bool writes_all() const { return selected.all(); }
+
+  std::ofstream open(fs::path const& relative)
+  {
+    auto path = dest / relative;
+    if (path.parent_path() != last_dir)
+    {
+      last_dir = path.parent_path();
+      fs::create_directories(last_dir);
+    }
+    std::error_code ec;
+    if (fs::is_symlink(path, ec))
+      fs::remove(path, ec);
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    if (!out)
+      throw std::runtime_error(fmt::format("Cannot write {}", path.generic_string()));
+    ++files;
+    return out;
+  }
+
+  /// @brief Closes a file opened by open, a failed write (a full disk) throws so the archive is not marked extracted
+  void close(std::ofstream& out, fs::path const& relative)
+  {
+    out.close();
+    if (!out)
+      throw std::runtime_error(fmt::format("Cannot write {}", (dest / relative).generic_string()));
+  }
+
+  void directory(fs::path const& relative)
+  {
+    if (selected.all())
+      fs::create_directories(dest / relative);
+  }
+
+  void mode(fs::path const& relative, std::uint32_t m)
+  {
+    // Only the executable bits matter for sources, and only where there are permissions to set
+    if (m & 0111)
+    {
+      std::error_code ec;
+      fs::permissions(dest / relative, static_cast<fs::perms>(m & 0777), fs::perm_options::replace, ec);
+    }
+  }
+
+  void symlink(fs::path const& relative, std::string target) { symlinks.emplace_back(relative, std::move(target)); }
+  void hardlink(fs::path const& relative, fs::path target) { hardlinks.emplace_back(relative, std::move(target)); }
+
+  void finish(std::uint64_t bytes_read)
+  {
+    std::error_code ec;
+    for (auto const& [relative, target] : hardlinks)
+    {
+      if (fs::is_regular_file(fs::symlink_status(dest / target, ec)))
+        fs::copy_file(dest / target, dest / relative, fs::copy_options::overwrite_existing, ec);
+    }
+    for (auto const& [relative, target] : symlinks)
+    {
+      auto path = dest / relative;
+      fs::create_directories(path.parent_path(), ec);
+      fs::remove(path, ec);
+      fs::create_symlink(target, path, ec);
+      if (ec)
+        nslog::warn(fmt::format("Cannot link {} to {}: {}", path.generic_string(), target, ec.message()));
+    }
+    nsprofile::touch(bytes_read, files);
+  }
+
+private:
+  fs::path                                      dest;
+  fs::path                                      last_dir;
+  selection                                     selected;
+  std::vector<std::pair<fs::path, std::string>> symlinks;
+  std::vector<std::pair<fs::path, fs::path>>    hardlinks;
+  std::uint64_t                                 files = 0;
+};
+
+/// @brief Sequential reader of the uncompressed tar stream
+class stream
+{
+public:
+  explicit stream(fs::path const& p) : path(p), in(p, std::ios::binary), input(k_chunk) {}
+  virtual ~stream() = default;
+
+  /// @brief Reads up to size bytes, 0 only at the end of the archive
+  virtual std::size_t read(char* data, std::size_t size) = 0;
+
+  bool read_exact(char* data, std::size_t size)
+  {
+    std::size_t done = 0;
+    while (done < size)
+    {
+      auto n = read(data + done, size - done);
+      if (n == 0)
+      {
+        if (done)
+          damaged(path, "unexpected end of data");
+        return false;
+      }
+      done += n;
+    }
+    return true;
+  }
+
+  std::uint64_t bytes_read = 0;
+
+protected:
+  std::size_t fill()
+  {
+    in.read(input.data(), static_cast<std::streamsize>(input.size()));
+    auto n = static_cast<std::size_t>(in.gcount());
+    bytes_read += n;
+    return n;
+  }
+
+  fs::path          path;
+  std::ifstream     in;
+  std::vector<char> input;
+};
+
+class plain_stream : public stream
+{
+public:
+  using stream::stream;
+
+  std::size_t read(char* data, std::size_t size) override
+  {
+    in.read(data, static_cast<std::streamsize>(size));
+    auto n = static_cast<std::size_t>(in.gcount());
+    bytes_read += n;
+    return n;
+  }
+};
+
+#ifdef NSBUILD_HAS_ZLIB
+class gzip_stream : public stream
+{
+public:
+  explicit gzip_stream(fs::path const& p) : stream(p)
+  {
+    // 32 detects the gzip header
+    if (inflateInit2(&z, 15 + 32) != Z_OK)
+      throw std::runtime_error("Cannot initialize zlib");
+  }
+  ~gzip_stream() override { inflateEnd(&z); }
+
+  std::size_t read(char* data, std::size_t size) override
+  {
+    z.next_out  = reinterpret_cast<Bytef*>(data);
+    z.avail_out = static_cast<uInt>(std::min<std::size_t>(size, k_chunk));
+    auto wanted = z.avail_out;
+    while (z.avail_out == wanted && !done)
+    {
+      if (z.avail_in == 0)
+      {
+        z.next_in  = reinterpret_cast<Bytef*>(input.data());
+        z.avail_in = static_cast<uInt>(fill());
+        if (z.avail_in == 0)
+          damaged(path, "unexpected end of gzip data");
+      }
+      auto r = inflate(&z, Z_NO_FLUSH);
+      if (r == Z_STREAM_END)
+      {
+        // gzip members may be concatenated
+        if (z.avail_in == 0 && in.peek() == std::char_traits<char>::eof())
+          done = true;
+        else
+          inflateReset(&z);
+      }
+      else if (r != Z_OK && r != Z_BUF_ERROR)
+        damaged(path, z.msg ? z.msg : "invalid gzip data");
+    }
+    return wanted - z.avail_out;
+  }
+
+private:
+  z_stream z{};
+  bool     done = false;
+};
+#endif
+
+#ifdef NSBUILD_HAS_LZMA
+class xz_stream : public stream
+{
+public:
+  explicit xz_stream(fs::path const& p) : stream(p)
+  {
+    if (lzma_stream_decoder(&x, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+      throw std::runtime_error("Cannot initialize liblzma");
+  }
+  ~xz_stream() override { lzma_end(&x); }
+
+  std::size_t read(char* data, std::size_t size) override
+  {
+    x.next_out  = reinterpret_cast<std::uint8_t*>(data);
+    x.avail_out = size;
+    while (x.avail_out == size && !done)
+    {
+      if (x.avail_in == 0 && !at_end)
+      {
+        x.next_in  = reinterpret_cast<std::uint8_t const*>(input.data());
+        x.avail_in = fill();
+        at_end     = x.avail_in == 0;
+      }
+      auto r = lzma_code(&x, at_end ? LZMA_FINISH : LZMA_RUN);
+      if (r == LZMA_STREAM_END)
+        done = true;
+      else if (r == LZMA_BUF_ERROR && at_end)
+        damaged(path, "unexpected end of xz data");
+      else if (r != LZMA_OK)
+        damaged(path, "invalid xz data");
+    }
+    return size - x.avail_out;
+  }
+
+private:
+  lzma_stream x      = LZMA_STREAM_INIT;
+  bool        at_end = false;
+  bool        done   = false;
+};
+#endif
+
+#ifdef NSBUILD_HAS_ZSTD
+class zstd_stream : public stream
+{
+public:
+  explicit zstd_stream(fs::path const& p) : stream(p), z(ZSTD_createDStream())
+  {
+    if (!z || ZSTD_isError(ZSTD_initDStream(z)))
+      throw std::runtime_error("Cannot initialize zstd");
+  }
+  ~zstd_stream() override { ZSTD_freeDStream(z); }
+
+  std::size_t read(char* data, std::size_t size) override
+  {
+    ZSTD_outBuffer out{data, size, 0};
+    while (out.pos == 0 && !done)
+    {
+      if (src.pos == src.size)
+      {
+        src = {input.data(), fill(), 0};
+        if (src.size == 0)
+        {
+          // 0 from the last call means a frame was complete
+          if (pending)
+            damaged(path, "unexpected end of zstd data");
+          done = true;
+          break;
+        }
+      }
+      auto r = ZSTD_decompressStream(z, &out, &src);
+      if (ZSTD_isError(r))
+        damaged(path, ZSTD_getErrorName(r));
+      pending = r != 0;
+    }
+    return out.pos;
+  }
+
+private:
+  ZSTD_DStream*  z;
+  ZSTD_inBuffer  src{nullptr, 0, 0};
+  bool           pending = false;
+  bool           done    = false;
+};
+#endif
+
+std::unique_ptr<stream> open_stream(format f, fs::path const& archive)
+{
+  switch (f)
+  {
+  case format::tar:
+    return std::make_unique<plain_stream>(archive);
+#ifdef NSBUILD_HAS_ZLIB
+  case format::gzip:
+    return std::make_unique<gzip_stream>(archive);
+#endif
+#ifdef NSBUILD_HAS_LZMA
+  case format::xz:
+    return std::make_unique<xz_stream>(archive);
+#endif
+#ifdef NSBUILD_HAS_ZSTD
+  case format::zstd:
+    return std::make_unique<zstd_stream>(archive);
+#endif
+  default:
+    return {};
+  }
+}
+
+// tar
+
+std::string_view field(char const* block, std::size_t offset, std::size_t size)
+{
+  std::string_view f{block + offset, size};
+  return f.substr(0, f.find('\0'));
+}
+
+/// @brief Octal, or base-256 big endian when the high bit is set (GNU tar, for sizes of 8GB and more)
+std::uint64_t number(char const* block, std::size_t offset, std::size_t size)
+{
+  std::uint64_t value = 0;
+  auto          data  = reinterpret_cast<unsigned char const*>(block + offset);
+  if (data[0] & 0x80)
+  {
+    value = data[0] & 0x7f;
+    for (std::size_t i = 1; i < size; ++i)
+      value = (value << 8) | data[i];
+    return value;
+  }
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    if (data[i] >= '0' && data[i] <= '7')
+      value = (value << 3) | (data[i] - '0');
+    else if (data[i] != ' ' || value)
+      break;
+  }
+  return value;
+}
+
+bool valid_header(char const* block)
+{
+  std::uint64_t sum = 0;
+  for (std::size_t i = 0; i < 512; ++i)
+    sum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(block[i]);
+  return sum == number(block, 148, 8);
+}
+
+void skip(stream& in, std::uint64_t size, std::vector<char>& buffer)
+{
+  while (size)
+  {
+    auto n = static_cast<std::size_t>(std::min<std::uint64_t>(size, buffer.size()));
+    if (!in.read_exact(buffer.data(), n))
+      return;
+    size -= n;
+  }
+}
+
+std::string read_text(stream& in, fs::path const& archive, std::uint64_t size)
+{
+  if (size > (1u << 20))
+    damaged(archive, "oversized extended header");
+  std::string text(static_cast<std::size_t>(size), '\0');
+  if (!in.read_exact(text.data(), text.size()))
+    damaged(archive, "unexpected end of data");
+  return text;
+}
+
+/// @brief path and linkpath records of a pax extended header, "<length> <key>=<value>\n"
+void read_pax(std::string_view text, std::string& name, std::string& link)
+{
+  while (!text.empty())
+  {
+    auto space = text.find(' ');
+    if (space == text.npos)
+      return;
+    std::size_t length = 0;
+    for (auto c : text.substr(0, space))
+      length = length * 10 + static_cast<std::size_t>(c - '0');
+    if (length <= space || length > text.size())
+      return;
+    auto record = text.substr(space + 1, length - space - 2);
+    auto eq     = record.find('=');
+    if (eq != record.npos)
+    {
+      auto key = record.substr(0, eq);
+      if (key == "path")
+        name = record.substr(eq + 1);
+      else if (key == "linkpath")
+        link = record.substr(eq + 1);
+    }
+    text.remove_prefix(length);
+  }
+}
+
+void extract_tar(stream& in, fs::path const& archive, writer& out)
+{
+  std::array<char, 512> block;
+  std::vector<char>     buffer(k_chunk);
+  std::string           long_name;
+  std::string           long_link;
+  while (in.read_exact(block.data(), block.size()))
+  {
+    if (std::ranges::all_of(block, [](char c) { return c == 0; }))
+      break;
+    if (!valid_header(block.data()))
+      damaged(archive, "invalid tar header");
+
+    auto size = number(block.data(), 124, 12);
+    auto type = block[156];
+    auto name = std::exchange(long_name, {});
+    auto link = std::exchange(long_link, {});
+    if (name.empty())
+    {
+      name        = field(block.data(), 0, 100);
+      auto prefix = field(block.data(), 345, 155);
+      if (field(block.data(), 257, 5) == "ustar" && !prefix.empty())
+        name = fmt::format("{}/{}", prefix, name);
+    }
+    if (link.empty())
+      link = field(block.data(), 157, 100);
+    auto padding = (512 - size % 512) % 512;
+
+    switch (type)
+    {
+    case 'L':
+      long_name = read_text(in, archive, size);
+      long_name.resize(long_name.find('\0') == long_name.npos ? long_name.size() : long_name.find('\0'));
+      skip(in, padding, buffer);
+      continue;
+    case 'K':
+      long_link = read_text(in, archive, size);
+      long_link.resize(long_link.find('\0') == long_link.npos ? long_link.size() : long_link.find('\0'));
+      skip(in, padding, buffer);
+      continue;
+    case 'x':
+      read_pax(read_text(in, archive, size), long_name, long_link);
+      skip(in, padding, buffer);
+      continue;
+    default:
+      break;
+    }
+
+    auto relative = relative_path(name);
+    switch (type)
+    {
+    case '0':
+    case '\0':
+    case '7':
+      if (out.wants(relative) && relative != ".")
+      {
+        auto file = out.open(relative);
+        for (auto left = size; left;)
+        {
+          auto n = static_cast<std::size_t>(std::min<std::uint64_t>(left, buffer.size()));
+          if (!in.read_exact(buffer.data(), n))
+            damaged(archive, "unexpected end of data");
+          file.write(buffer.data(), static_cast<std::streamsize>(n));
+          left -= n;
+        }
+        out.close(file, relative);
+        out.mode(relative, static_cast<std::uint32_t>(number(block.data(), 100, 8)));
+        size = 0;
+      }
+      break;
+    case '5':
+      out.directory(relative);
+      break;
+    case '2':
+      if (out.writes_all())
+        out.symlink(relative, link);
+      break;
+    case '1':
+      if (out.writes_all())
+        out.hardlink(relative, relative_path(link));
+      break;
+    default:
+      break;
+    }
+    skip(in, size + padding, buffer);
+  }
+}
+
+// zip
+
+class zip_reader
+{
+public:
+  zip_reader(fs::path const& a, std::string_view d) : archive(a), data(d) {}
+
+  std::uint64_t u16(std::uint64_t pos) const { return le(pos, 2); }
+  std::uint64_t u32(std::uint64_t pos) const { return le(pos, 4); }
+  std::uint64_t u64(std::uint64_t pos) const { return le(pos, 8); }
+
+  std::string_view bytes(std::uint64_t pos, std::uint64_t size) const
+  {
+    if (pos > data.size() || size > data.size() - pos)
+      damaged(archive, "entry out of bounds");
+    return data.substr(static_cast<std::size_t>(pos), static_cast<std::size_t>(size));
+  }
+
+  fs::path const&  archive;
+  std::string_view data;
+
+private:
+  std::uint64_t le(std::uint64_t pos, int size) const
+  {
+    auto          b     = bytes(pos, size);
+    std::uint64_t value = 0;
+    for (int i = size - 1; i >= 0; --i)
+      value = (value << 8) | static_cast<unsigned char>(b[i]);
+    return value;
+  }
+};
+
+struct zip_entry
+{
+  std::string   name;
+  std::uint64_t method;
+  std::uint64_t crc;
+  std::uint64_t compressed;
+  std::uint64_t size;
+  std::uint64_t offset;
+  std::uint32_t mode;
+};
+
+std::vector<zip_entry> read_directory(zip_reader const& z)
+{
+  // End of central directory, followed by a comment of up to 64KB
+  constexpr std::uint64_t k_eocd = 22;
+  if (z.data.size() < k_eocd)
+    damaged(z.archive, "no central directory");
+  std::uint64_t eocd = z.data.size() - k_eocd;
+  std::uint64_t stop = eocd > 0xffff ? eocd - 0xffff : 0;
+  while (z.u32(eocd) != 0x06054b50)
+  {
+    if (eocd == stop)
+      damaged(z.archive, "no central directory");
+    --eocd;
+  }
+  std::uint64_t count  = z.u16(eocd + 10);
+  std::uint64_t offset = z.u32(eocd + 16);
+  // Zip64 end of central directory locator
+  if (eocd >= 20 && z.u32(eocd - 20) == 0x07064b50)
+  {
+    auto eocd64 = z.u64(eocd - 20 + 8);
+    if (z.u32(eocd64) != 0x06064b50)
+      damaged(z.archive, "invalid zip64 directory");
+    count  = z.u64(eocd64 + 32);
+    offset = z.u64(eocd64 + 48);
+  }
+
+  std::vector<zip_entry> entries;
+  entries.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(count, 1u << 20)));
+  for (std::uint64_t i = 0; i < count; ++i)
+  {
+    if (z.u32(offset) != 0x02014b50)
+      damaged(z.archive, "invalid central directory entry");
+    auto name_length    = z.u16(offset + 28);
+    auto extra_length   = z.u16(offset + 30);
+    auto comment_length = z.u16(offset + 32);
+    auto made_by        = z.u16(offset + 4);
+    auto attributes     = z.u32(offset + 38);
+
+    zip_entry e;
+    e.method     = z.u16(offset + 10);
+    e.crc        = z.u32(offset + 16);
+    e.compressed = z.u32(offset + 20);
+    e.size       = z.u32(offset + 24);
+    e.offset     = z.u32(offset + 42);
+    e.name       = z.bytes(offset + 46, name_length);
+    // Unix hosts keep the file mode in the upper half of the external attributes
+    e.mode       = (made_by >> 8) == 3 ? static_cast<std::uint32_t>(attributes >> 16) : 0;
+
+    // Zip64 sizes and offset, present only for the fields that overflowed
+    auto extra = offset + 46 + name_length;
+    for (auto end = extra + extra_length; extra + 4 <= end;)
+    {
+      auto id   = z.u16(extra);
+      auto size = z.u16(extra + 2);
+      if (id == 0x0001)
+      {
+        auto field = extra + 4;
+        for (auto* value : {&e.size, &e.compressed, &e.offset})
+        {
+          if (*value == 0xffffffff && field + 8 <= extra + 4 + size)
+          {
+            *value = z.u64(field);
+            field += 8;
+          }
+        }
+      }
+      extra += 4 + size;
+    }
+    entries.emplace_back(std::move(e));
+    offset += 46 + name_length + extra_length + comment_length;
+  }
+  return entries;
+}
+
+bool can_inflate(zip_entry const& e)
+{
+#ifdef NSBUILD_HAS_ZLIB
+  return e.method == 0 || e.method == 8;
+#else
+  return e.method == 0;
+#endif
+}
+
+/// @brief Streams the entry data to sink, in chunks
+template <typename Sink>
+void unpack(zip_reader const& z, zip_entry const& e, std::vector<char>& buffer, Sink&& sink)
+{
+  if (z.u32(e.offset) != 0x04034b50)
+    damaged(z.archive, fmt::format("invalid local header for {}", e.name));
+  auto packed = z.bytes(e.offset + 30 + z.u16(e.offset + 26) + z.u16(e.offset + 28), e.compressed);
+#ifdef NSBUILD_HAS_ZLIB
+  uLong crc = crc32(0, nullptr, 0);
+  auto  out = [&](char const* data, std::size_t size)
+  {
+    // crc32 takes a 32 bit length
+    for (std::size_t done = 0; done < size; done += k_chunk)
+      crc = crc32(crc, reinterpret_cast<Bytef const*>(data + done),
+                  static_cast<uInt>(std::min<std::size_t>(k_chunk, size - done)));
+    sink(data, size);
+  };
+#else
+  auto& out = sink;
+#endif
+
+  if (e.method == 0)
+  {
+    if (e.compressed != e.size)
+      damaged(z.archive, fmt::format("size mismatch for {}", e.name));
+    out(packed.data(), packed.size());
+  }
+#ifdef NSBUILD_HAS_ZLIB
+  else
+  {
+    z_stream s{};
+    // Raw deflate, zip entries have no zlib header
+    if (inflateInit2(&s, -15) != Z_OK)
+      throw std::runtime_error("Cannot initialize zlib");
+    std::unique_ptr<z_stream, int (*)(z_stream*)> guard{&s, inflateEnd};
+    std::uint64_t                                 fed     = 0;
+    std::uint64_t                                 written = 0;
+    while (true)
+    {
+      if (s.avail_in == 0 && fed < packed.size())
+      {
+        auto n     = std::min<std::uint64_t>(packed.size() - fed, 1u << 30);
+        s.next_in  = reinterpret_cast<Bytef*>(const_cast<char*>(packed.data() + fed));
+        s.avail_in = static_cast<uInt>(n);
+        fed += n;
+      }
+      s.next_out  = reinterpret_cast<Bytef*>(buffer.data());
+      s.avail_out = static_cast<uInt>(buffer.size());
+      auto r      = inflate(&s, Z_NO_FLUSH);
+      auto n      = buffer.size() - s.avail_out;
+      out(buffer.data(), n);
+      written += n;
+      if (r == Z_STREAM_END)
+        break;
+      if ((r != Z_OK && r != Z_BUF_ERROR) || (n == 0 && s.avail_in == 0 && fed == packed.size()))
+        damaged(z.archive, fmt::format("invalid deflate data for {}", e.name));
+    }
+    if (written != e.size)
+      damaged(z.archive, fmt::format("size mismatch for {}", e.name));
+  }
+  if (crc != e.crc)
+    damaged(z.archive, fmt::format("checksum mismatch for {}", e.name));
+#endif
+}
+
+bool extract_zip(fs::path const& archive, writer& out)
+{
+  nsmapped_file file{archive};
+  if (!file.is_open())
+    throw std::runtime_error(fmt::format("Cannot read {}", archive.generic_string()));
+  zip_reader z{archive, file.view()};
+  auto       entries = read_directory(z);
+  // Shared by the entries, allocating it for each file would cost more than inflating small files
+  std::vector<char> buffer(k_chunk);
+  // Nothing is written unless every entry can be read
+  if (!std::ranges::all_of(entries, can_inflate))
+    return false;
+
+  constexpr std::uint32_t k_type      = 0170000;
+  constexpr std::uint32_t k_symlink   = 0120000;
+  constexpr std::uint32_t k_directory = 0040000;
+  for (auto const& e : entries)
+  {
+    auto relative = relative_path(e.name);
+    if (e.name.ends_with('/') || (e.mode & k_type) == k_directory)
+      out.directory(relative);
+    else if ((e.mode & k_type) == k_symlink)
+    {
+      if (!out.writes_all())
+        continue;
+      std::string target;
+      unpack(z, e, buffer, [&target](char const* data, std::size_t size) { target.append(data, size); });
+      out.symlink(relative, std::move(target));
+    }
+    else if (out.wants(relative))
+    {
+      auto f = out.open(relative);
+      unpack(z, e, buffer,
+             [&f](char const* data, std::size_t size) { f.write(data, static_cast<std::streamsize>(size)); });
+      out.close(f, relative);
+      out.mode(relative, e.mode);
+    }
+  }
+  out.finish(0);
+  return true;
+}
+} // namespace
+
+bool extract(fs::path const& archive, fs::path const& dest, std::vector<std::string> const& only)
+{
+  nsprofile::span span{"archive extract", archive};
+  auto            f = detect(archive);
+  writer          out{dest, only};
+  if (f == format::zip)
+    return extract_zip(archive, out);
+
+  auto in = open_stream(f, archive);
+  if (!in)
+    return false;
+  extract_tar(*in, archive, out);
+  out.finish(in->bytes_read);
+  return true;
+}
+} // namespace nsarchive
@@ -0,0 +1,264 @@
+#include "nsbincache.h"
+
+#include "nsbuild.h"
+#include "nscmake.h"
+#include "nslog.h"
+#include "nsmmap.h"
+#include "nsprocess.h"
+#include "nsprofile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace nsbincache
+{
+namespace
+{
+namespace fs = std::filesystem;
+
+fs::path archive_path(nsbuild const& bc, std::string_view key)
+{
+  return bc.get_full_bincache_dir() / fmt::format("{}.tar.zst", key);
+}
+
+fs::path list_path(nsbuild const& bc, std::string_view key)
+{
+  return bc.get_full_bincache_dir() / fmt::format("{}.txt", key);
+}
+
+fs::path reloc_path(nsbuild const& bc, std::string_view key)
+{
+  return bc.get_full_bincache_dir() / fmt::format("{}.reloc", key);
+}
+
+using dir_map = std::vector<std::pair<std::string, std::string>>;
+
+/// @brief Placeholder -> directory of this workspace, nested directories first like relocatable
+dir_map workspace_dirs(nsbuild const& bc)
+{
+  return {{"<cfg>", cmake::path(bc.get_full_cfg_dir())},
+          {"<dl>", cmake::path(bc.get_full_dl_dir())},
+          {"<out>", cmake::path(bc.get_full_out_dir())},
+          {"<src>", cmake::path(bc.get_full_source_dir())}};
+}
+
+/// @brief Text files only, a zero byte near the start marks a binary like it does for git
+bool is_text(std::string_view content)
+{
+  return content.substr(0, 8000).find('\0') == content.npos;
+}
+
+/// @brief Replaces every from directory by its to counterpart in one pass, a replacement is never matched again
+std::string relocate(std::string_view text, dir_map const& from, dir_map const& to)
+{
+  std::string out;
+  out.reserve(text.size());
+  std::size_t pos = 0;
+  while (pos < text.size())
+  {
+    bool replaced = false;
+    for (std::size_t i = 0; i < from.size() && !replaced; ++i)
+    {
+      auto const& dir = from[i].second;
+      if (!dir.empty() && text.substr(pos).starts_with(dir))
+      {
+        out += to[i].second;
+        pos += dir.size();
+        replaced = true;
+      }
+    }
+    if (!replaced)
+      out += text[pos++];
+  }
+  return out;
+}
+
+void replace_all(std::string& text, std::string const& what, std::string_view with)
+{
+  if (what.empty())
+    return;
+  for (auto pos = text.find(what); pos != text.npos; pos = text.find(what, pos + with.size()))
+    text.replace(pos, what.size(), with);
+}
+} // namespace
+
+std::string relocatable(nsbuild const& bc, std::string text)
+{
+  // Nested directories first, the preset dir is inside the out dir which may be inside the source dir
+  replace_all(text, cmake::path(bc.get_full_cfg_dir()), "<cfg>");
+  replace_all(text, cmake::path(bc.get_full_dl_dir()), "<dl>");
+  replace_all(text, cmake::path(bc.get_full_out_dir()), "<out>");
+  replace_all(text, cmake::path(bc.get_full_source_dir()), "<src>");
+  return text;
+}
+
+bool restore(nsbuild const& bc, std::string_view key, fs::path const& prefix, fs::path const& manifest)
+{
+  if (bc.get_full_bincache_dir().empty())
+    return false;
+  auto archive = archive_path(bc, key);
+  auto list    = list_path(bc, key);
+  if (!fs::exists(archive) || !fs::exists(list))
+    return false;
+
+  nsprofile::span span{"binary cache restore", key};
+  try
+  {
+    nsprocess::cmake(bc, {"-E", "tar", "xf", cmake::path(archive)}, prefix);
+  }
+  catch (std::exception& e)
+  {
+    nslog::warn(fmt::format("Binary cache entry {} could not be unpacked: {}", key, e.what()));
+    return false;
+  }
+
+  // Text files that name the workspace the entry was stored from, they are pointed at this one
+  std::ifstream reloc{reloc_path(bc, key)};
+  if (reloc.is_open())
+  {
+    auto        here = workspace_dirs(bc);
+    dir_map     there;
+    std::string line;
+    while (std::getline(reloc, line))
+    {
+      auto space = line.find(' ');
+      if (space == line.npos)
+        continue;
+      auto tag  = line.substr(0, space);
+      auto rest = line.substr(space + 1);
+      if (tag != "file")
+      {
+        there.emplace_back(std::move(tag), std::move(rest));
+        continue;
+      }
+      if (!std::ranges::equal(there, here, {}, &dir_map::value_type::first, &dir_map::value_type::first))
+      {
+        nslog::warn(fmt::format("Binary cache entry {} has a damaged relocation list", key));
+        return false;
+      }
+      // Stored from this workspace
+      if (there == here)
+        continue;
+
+      auto        file = prefix / rest;
+      std::string text;
+      {
+        std::ifstream      iff{file, std::ios::binary};
+        std::ostringstream ss;
+        ss << iff.rdbuf();
+        text = ss.str();
+      }
+      std::ofstream off{file, std::ios::binary | std::ios::trunc};
+      auto          moved = relocate(text, there, here);
+      off.write(moved.data(), static_cast<std::streamsize>(moved.size()));
+      off.close();
+      if (!off)
+      {
+        nslog::warn(fmt::format("Binary cache entry {} could not be relocated into {}", key, cmake::path(file)));
+        return false;
+      }
+    }
+  }
+
+  // The manifest cmake --install would have written, it drives uninstalls and runtime deployment
+  std::ifstream files{list};
+  fs::create_directories(manifest.parent_path());
+  std::ofstream out{manifest};
+  std::string   line;
+  std::size_t   count = 0;
+  while (std::getline(files, line))
+  {
+    if (line.empty())
+      continue;
+    out << cmake::path(prefix / line) << "\n";
+    ++count;
+  }
+  nsprofile::touch(fs::file_size(archive), count);
+  return true;
+}
+
+std::vector<std::string> installed_files(fs::path const& prefix, fs::path const& manifest)
+{
+  std::vector<std::string> files;
+  std::ifstream            installed{manifest};
+  std::string              line;
+  while (std::getline(installed, line))
+  {
+    if (line.empty())
+      continue;
+    auto relative = fs::path(line).lexically_normal().lexically_relative(prefix);
+    if (relative.empty() || *relative.begin() == "..")
+    {
+      nslog::warn(fmt::format("{} is installed outside the sdk, the fetch is not cached", line));
+      return {};
+    }
+    files.emplace_back(relative.generic_string());
+  }
+  return files;
+}
+
+void store(nsbuild const& bc, std::string_view key, fs::path const& prefix, std::vector<std::string> const& files)
+{
+  auto dir = bc.get_full_bincache_dir();
+  if (dir.empty() || files.empty() || fs::exists(archive_path(bc, key)))
+    return;
+
+  nsprofile::span span{"binary cache store", key};
+  // Installed config files, scripts and pkg-config files often hold absolute paths, restore rewrites them
+  auto                     here = workspace_dirs(bc);
+  std::vector<std::string> relocated;
+  for (auto const& f : files)
+  {
+    auto          path = prefix / f;
+    nsmapped_file content;
+    if (fs::is_symlink(path) || !content.open(path) || !is_text(content.view()))
+      continue;
+    auto names = [&content](auto const& d) { return content.view().find(d.second) != std::string_view::npos; };
+    if (std::ranges::any_of(here, names))
+      relocated.push_back(f);
+  }
+
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+  // Written aside and renamed in, workspaces sharing the cache only ever see complete entries
+  auto unique = std::chrono::steady_clock::now().time_since_epoch().count();
+  auto list   = dir / fmt::format("{}.{}.txt", key, unique);
+  auto pack   = dir / fmt::format("{}.{}.tar.zst", key, unique);
+  auto reloc  = dir / fmt::format("{}.{}.reloc", key, unique);
+  {
+    std::ofstream out{list};
+    for (auto const& f : files)
+      out << f << "\n";
+  }
+  if (!relocated.empty())
+  {
+    std::ofstream out{reloc};
+    for (auto const& d : here)
+      out << d.first << " " << d.second << "\n";
+    for (auto const& f : relocated)
+      out << "file " << f << "\n";
+  }
+  try
+  {
+    nsprocess::cmake(
+        bc, {"-E", "tar", "cf", cmake::path(pack), "--zstd", fmt::format("--files-from={}", cmake::path(list))},
+        prefix);
+    if (!relocated.empty())
+      fs::rename(reloc, reloc_path(bc, key));
+    fs::rename(list, list_path(bc, key));
+    // Last, an entry is complete once its archive is there
+    fs::rename(pack, archive_path(bc, key));
+  }
+  catch (std::exception& e)
+  {
+    nslog::warn(fmt::format("Binary cache entry {} could not be stored: {}", key, e.what()));
+    fs::remove(list, ec);
+    fs::remove(pack, ec);
+    fs::remove(reloc, ec);
+  }
+}
+} // namespace nsbincache
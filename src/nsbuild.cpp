@@ -2,10 +2,19 @@
 
 #include "nscmake.h"
 #include "nscmake_conststr.h"
+#include "nscopy.h"
 #include "nsenums.h"
+#include "nshash.h"
 #include "nsheader_map.h"
-#include "picosha2.h"
-
+#include "nsmedia.h"
+#include "nssnapshot.h"
+
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
 #include <exception>
 #include <fmt/format.h>
 #include <fmt/printf.h>
@@ -14,12 +23,20 @@
 #include <iomanip>
 #include <iterator>
 #include <mutex>
+#include <set>
 #include <nslog.h>
+#include <nsparallel.h>
 #include <nsprocess.h>
+#include <nsprofile.h>
 #include <stdexcept>
 #include <string>
 #include <unordered_set>
 
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__))
+#include <sys/stat.h>
+#define NS_BUILD_POSIX
+#endif
+
 extern void halt();
 nsbuild::nsbuild()
 {
@@ -65,40 +82,67 @@ void nsbuild::main_project()
     path = get_full_out_dir() / preset.name / cache_dir;
     if (std::filesystem::exists(path))
     {
-      auto dit = std::filesystem::directory_iterator(path);
-      for (auto const& it : dit)
-      {
-        if (it.path().extension() == ".glob")
-          std::filesystem::remove(it.path());
-      }
+      nsstatedb db;
+      db.open(path / "state.db");
+      db.erase_prefix("glob/");
     }
   }
 }
 
 bool nsbuild::scan_file(std::filesystem::path path, bool store, std::string* sha)
 {
-  std::ifstream iff(path);
-  if (iff.is_open())
-  {
-    std::string f1_str;
-    auto        size = std::filesystem::file_size(path);
-    f1_str.resize(size, ' ');
-    iff.read(f1_str.data(), size);
+  return scan_file(reg, std::move(path), store, sha);
+}
 
-    contents.emplace_back(std::move(f1_str));
+bool nsbuild::scan_file(neo::registry& with, std::filesystem::path path, bool store, std::string* sha)
+{
+  std::string_view source;
+  if (!sources->read(path, source))
+    return false;
 
-    neo::state_machine sm{reg, this};
-    sm.parse(path.string(), contents.back());
-    handle_error(sm);
-    if (sha)
-    {
-      picosha2::hash256_hex_string(contents.back(), *sha);
-    }
-    if (!store)
-      contents.pop_back();
+  parse(with, path, source);
+  if (sha)
+  {
+    *sha = nshash::fast_hex(source);
+  }
+  if (!store)
+    sources->pop(source);
+  return true;
+}
+
+bool nsbuild::scan_module(neo::registry& with, std::filesystem::path const& sp, std::string& hash)
+{
+  auto path = sp / "Module.ns";
+  // The stored hash is current when nothing under the module dir changed since it was written
+  bool unchanged = journal->is_valid() && !journal->touched(sp) &&
+                   state_db->get(fmt::format("sha/{}", s_nsmodule->name), hash);
+  if (!unchanged)
+    hash = gather_module_hash(sp);
+  // Presets and filters change what a Module.ns parses into
+  auto snapshot = get_full_cache_dir() / fmt::format("{}.{}.snapshot", s_nsmodule->framework_name, s_nsmodule->name);
+  if (nssnapshot::load(*s_nsmodule, snapshot, hash + build_ns_sha, contents))
+  {
+    // A module also owns the download dirs of its fetches
+    auto touched          = [this](nsfetch const& ft) { return journal->touched(get_full_dl_dir() / ft.name); };
+    s_nsmodule->unchanged = unchanged && std::ranges::none_of(s_nsmodule->fetch, touched);
     return true;
   }
-  return false;
+  if (unchanged)
+    hash = gather_module_hash(sp);
+
+  std::string_view source;
+  if (!sources->read(path, source))
+    return false;
+  parse(with, path, source);
+  nssnapshot::save(*s_nsmodule, snapshot, hash + build_ns_sha);
+  return true;
+}
+
+void nsbuild::parse(neo::registry& with, std::filesystem::path const& path, std::string_view content)
+{
+  neo::state_machine sm{with, this};
+  sm.parse(path.string(), content);
+  handle_error(sm);
 }
 
 void nsbuild::handle_error(neo::state_machine& err)
@@ -127,14 +171,17 @@ void nsbuild::clean_install()
   // At this point we have read config!
   compute_paths(cmakeinfo.cmake_preset_name);
   std::filesystem::create_directories(get_full_cache_dir());
+  state_db->open(get_full_cache_dir() / "state.db");
   read_meta(get_full_cache_dir());
-  foreach_framework([this](std::filesystem::path p) { read_framework(p); });
+  read_frameworks();
   state.delete_builds = true;
   delete_builds_if_required();
+  state_db->flush();
 }
 
 void nsbuild::before_all()
 {
+  nsprofile::span span{"before_all", cmakeinfo.cmake_preset_name};
   for (auto const& preset : presets)
     if (preset.name == cmakeinfo.cmake_preset_name)
     {
@@ -146,9 +193,15 @@ void nsbuild::before_all()
   // At this point we have read config!
   compute_paths(cmakeinfo.cmake_preset_name);
   std::filesystem::create_directories(get_full_cache_dir());
+  state_db->open(get_full_cache_dir() / "state.db");
   read_meta(get_full_cache_dir());
   act_meta();
-  foreach_framework([this](std::filesystem::path p) { read_framework(p); });
+  stat_cache->load(get_full_cache_dir() / "stat_cache.txt");
+  dir_cache->load(get_full_cache_dir() / "dir_cache.txt");
+  journal->load(get_full_cache_dir() / "watch.journal", *state_db, get_full_source_dir() / frameworks_dir);
+  if (journal->is_valid())
+    nslog::print("Using the watch journal, unchanged modules are not scanned");
+  read_frameworks();
   delete_builds_if_required();
   update_macros();
   try
@@ -164,10 +217,18 @@ void nsbuild::before_all()
     nslog::print("******************************************\n");
     // Still write out meta
     write_meta(get_full_cache_dir());
+    stat_cache->save(get_full_cache_dir() / "stat_cache.txt", !journal->is_valid());
+    dir_cache->save(get_full_cache_dir() / "dir_cache.txt", !journal->is_valid());
+    state_db->flush();
     throw;
   }
   copy_installed_binaries();
   write_meta(get_full_cache_dir());
+  // Modules skipped through the journal did not query their files, keep their entries
+  stat_cache->save(get_full_cache_dir() / "stat_cache.txt", !journal->is_valid());
+  dir_cache->save(get_full_cache_dir() / "dir_cache.txt", !journal->is_valid());
+  journal->commit(*state_db);
+  state_db->flush();
 
   if (state.is_dirty || state.exit_and_rebuild)
   {
@@ -214,23 +275,12 @@ void nsbuild::header_map(std::filesystem::path targ_file)
 
 bool nsbuild::read_sha(std::string_view name, std::string const& current) const
 {
-  std::ifstream sha_file(get_full_cache_dir() / fmt::format("{}.sha", name));
-  if (sha_file.is_open())
-  {
-    std::string sha;
-    std::getline(sha_file, sha);
-    return sha == current;
-  }
-  return false;
+  return state_db->matches(fmt::format("sha/{}", name), current);
 }
 
 void nsbuild::write_sha(std::string_view name, std::string const& current) const
 {
-  std::ofstream sha_file(get_full_cache_dir() / fmt::format("{}.sha", name));
-  if (sha_file.is_open())
-  {
-    sha_file << current << std::endl;
-  }
+  state_db->put(fmt::format("sha/{}", name), current);
 }
 
 void nsbuild::read_meta(std::filesystem::path const& path)
@@ -298,6 +348,7 @@ void nsbuild::write_meta(std::filesystem::path const& path)
 
 void nsbuild::scan_main(std::filesystem::path sp)
 {
+  nsprofile::span span{"scan_main", sp};
   if (sp.is_absolute())
   {
     wd = sp;
@@ -308,8 +359,101 @@ void nsbuild::scan_main(std::filesystem::path sp)
     scan_file(sp / "Build.ns", true, &build_ns_sha);
 }
 
+void nsbuild::read_frameworks()
+{
+  nsprofile::span span{"read_frameworks"};
+  if (parallel_scan)
+    read_frameworks_parallel();
+  else
+    foreach_framework([this](std::filesystem::path p) { read_framework(p); });
+}
+
+void nsbuild::read_frameworks_parallel()
+{
+  struct module_job
+  {
+    std::filesystem::path    path;
+    std::uint32_t            fw_idx   = 0;
+    bool                     excluded = false;
+    bool                     changed  = false;
+    nsmodule                 module;
+    std::list<nsmapped_file> contents;
+    std::string              hash;
+  };
+
+  std::vector<std::filesystem::path> fw_paths;
+  foreach_framework([&fw_paths](std::filesystem::path p) { fw_paths.emplace_back(std::move(p)); });
+  std::ranges::sort(fw_paths);
+
+  // Framework.ns files are few and carry the excludes, read them before queueing modules
+  std::vector<module_job> jobs;
+  for (auto const& fw : fw_paths)
+  {
+    add_framework(fw.filename().string());
+    scan_file(fw / "Framework.ns", false);
+
+    std::vector<std::filesystem::path> mod_paths;
+    foreach_module([&mod_paths](std::filesystem::path m) { mod_paths.emplace_back(std::move(m)); }, fw);
+    std::ranges::sort(mod_paths);
+    for (auto& m : mod_paths)
+    {
+      auto& job    = jobs.emplace_back();
+      job.fw_idx   = static_cast<std::uint32_t>(frameworks.size() - 1);
+      job.excluded = frameworks.back().excludes.contains(m.filename().string());
+      job.path     = std::move(m);
+    }
+  }
+
+  nsparallel::for_each(jobs.size(),
+                       [this, &jobs](std::size_t i)
+                       {
+                         auto& job = jobs[i];
+                         if (job.excluded)
+                           return;
+                         nsprofile::span span{"read_module", job.path};
+                         // Handlers write through the s_ cursors, so each module gets its own context
+                         nsbuild ctx;
+                         ctx.s_current_preset = s_current_preset;
+                         ctx.state.ras        = state.ras;
+                         ctx.build_ns_sha     = build_ns_sha;
+                         ctx.paths            = paths;
+                         ctx.stat_cache       = stat_cache;
+                         ctx.state_db         = state_db;
+                         ctx.journal          = journal;
+                         ctx.sources          = sources;
+                         ctx.add_framework(frameworks[job.fw_idx].name);
+                         ctx.add_module(job.path.filename().string(), job.path);
+                         if (!ctx.scan_module(reg, job.path, job.hash))
+                           throw std::runtime_error(fmt::format("Could not read {}", (job.path / "Module.ns").string()));
+
+                         job.changed = !read_sha(ctx.s_nsmodule->name, job.hash);
+                         job.module  = std::move(*ctx.s_nsmodule);
+                         job.contents.splice(job.contents.end(), ctx.contents);
+                       });
+
+  for (auto& job : jobs)
+  {
+    s_nsframework = &frameworks[job.fw_idx];
+    if (job.excluded)
+    {
+      add_module(job.path.filename().string(), job.path);
+      s_nsmodule->disabled = true;
+      continue;
+    }
+    // String views in the module point into its snapshot mappings or the shared source arena, list splicing keeps
+    // the mappings in place
+    contents.splice(contents.end(), job.contents);
+    s_nsframework->modules.emplace_back(std::move(job.module));
+    s_nsmodule = &s_nsframework->modules.back();
+    add_target(job.fw_idx, job.hash, job.changed);
+  }
+  s_nsframework = nullptr;
+  s_nsmodule    = nullptr;
+}
+
 void nsbuild::read_framework(std::filesystem::path sp)
 {
+  nsprofile::span span{"read_framework", sp};
   auto fwname = sp.filename().string();
   add_framework(fwname);
   scan_file(sp / "Framework.ns", false);
@@ -318,53 +462,53 @@ void nsbuild::read_framework(std::filesystem::path sp)
 
 void nsbuild::read_module(std::filesystem::path sp)
 {
-  auto mod_name  = sp.filename().string();
-  auto fwname    = sp.parent_path().filename().string();
-  auto targ_name = target_name(fwname, mod_name);
+  nsprofile::span span{"read_module", sp};
+  auto mod_name = sp.filename().string();
   add_module(mod_name, sp);
 
   if (!frameworks.back().excludes.contains(mod_name))
   {
     std::string hash_hex_str;
-    scan_file(sp / "Module.ns", true, nullptr);
-    hash_hex_str = gather_module_hash(sp);
-    // Check if timestamp has changed
-    s_nsmodule->set_sha(hash_hex_str);
-    if (!read_sha(mod_name, hash_hex_str) || state.full_regenerate)
-    {
-      nslog::warn(fmt::format("{} has changed. Regenerating!", targ_name));
-
-      s_nsmodule->should_regenerate();
-      state.is_dirty = true;
-    }
-    // Add a target
-    auto t                  = targets.emplace(targ_name, nstarget{});
-    t.first->second.sha256  = hash_hex_str;
-    t.first->second.fw_idx  = static_cast<std::uint32_t>(frameworks.size() - 1);
-    t.first->second.mod_idx = static_cast<std::uint32_t>(frameworks.back().modules.size() - 1);
+    scan_module(reg, sp, hash_hex_str);
+    add_target(static_cast<std::uint32_t>(frameworks.size() - 1), hash_hex_str,
+               !read_sha(mod_name, hash_hex_str));
   }
   else
     s_nsmodule->disabled = true;
 }
 
-std::string nsbuild::gather_module_hash(std::filesystem::path const& path)
+void nsbuild::add_target(std::uint32_t fw_idx, std::string const& hash_hex_str, bool changed)
 {
-  std::stringstream buffer;
-  buffer << contents.back();
-  auto others = std::array{"Prepare.cmake", "Finalize.cmake"};
-  for (auto const& o : others)
+  auto& fw        = frameworks[fw_idx];
+  auto& mod       = fw.modules.back();
+  auto  targ_name = target_name(fw.name, mod.name);
+  // Check if timestamp has changed
+  mod.set_sha(hash_hex_str);
+  if (changed || state.full_regenerate)
   {
-    auto prepare = path / o;
-    if (std::filesystem::exists(prepare))
-    {
-      std::ifstream iff(prepare);
-      buffer << iff.rdbuf();
-    }
+    nslog::warn(fmt::format("{} has changed. Regenerating!", targ_name));
+
+    mod.should_regenerate();
+    state.is_dirty = true;
+  }
+  // Add a target
+  auto t                  = targets.emplace(targ_name, nstarget{});
+  t.first->second.sha256  = hash_hex_str;
+  t.first->second.fw_idx  = fw_idx;
+  t.first->second.mod_idx = static_cast<std::uint32_t>(fw.modules.size() - 1);
+}
+
+std::string nsbuild::gather_module_hash(std::filesystem::path const& path) const
+{
+  nsprofile::span span{"hash", path};
+  std::string     content;
+  auto            inputs = std::array{"Module.ns", "Prepare.cmake", "Finalize.cmake"};
+  for (auto const& i : inputs)
+  {
+    content += stat_cache->digest(path / i);
+    content += "\n";
   }
-  auto        content = buffer.str();
-  std::string sha;
-  picosha2::hash256_hex_string(content, sha);
-  return sha;
+  return nshash::fast_hex(content);
 }
 
 template <typename L>
@@ -398,13 +542,49 @@ void nsbuild::foreach_module(L&& l, std::filesystem::path fwpath)
 
 void nsbuild::process_targets()
 {
+  nsprofile::span span{"process_targets"};
+  prefetch();
   for (auto& targ : targets)
     process_target(targ.first, targ.second);
+  build_fetches();
 
+  accumulate_globs(false);
+  // Unchanged modules are only walked when the module list is written again
+  if (state.is_dirty)
+    accumulate_globs(true);
   write_include_modules();
   nslog::print("Finished writing targets");
 }
 
+void nsbuild::prefetch()
+{
+  struct pending
+  {
+    nsmodule* mod;
+    nsfetch*  ft;
+  };
+  std::vector<pending> downloads;
+  foreach_module(
+      [&](nsmodule& m)
+      {
+        if (m.disabled)
+          return;
+        m.update_fetch_state(*this);
+        for (auto& ft : m.fetch)
+          if (!ft.repo.empty() && !ft.disabled && m.needs_download(*this, ft))
+            downloads.push_back({&m, &ft});
+      });
+  // A single download is left to its module
+  if (fetch_jobs < 2 || downloads.size() < 2)
+    return;
+
+  nsprofile::span span{"prefetch"};
+  auto            jobs = static_cast<unsigned>(std::min<std::size_t>(fetch_jobs, downloads.size()));
+  nslog::print(fmt::format("Downloading {} fetches, {} at a time", downloads.size(), jobs));
+  nsparallel::for_each(downloads.size(), jobs,
+                       [&](std::size_t i) { downloads[i].mod->prefetch(*this, *downloads[i].ft); });
+}
+
 void nsbuild::process_target(std::string const& name, nstarget& targ)
 {
   if (targ.processed)
@@ -443,43 +623,227 @@ void nsbuild::process_target(std::string const& name, nstarget& targ)
 
   sorted_targets.push_back(name);
   mod.process(*this, install_cache, name, targ);
-  if (mod.was_fetch_rebuilt)
+}
+
+void nsbuild::build_fetches()
+{
+  // Processing order puts dependencies first, edges only point back so cycles between modules are cut as before
+  std::vector<nsmodule*>                            modules;
+  std::unordered_map<std::string_view, std::size_t> order;
+  modules.reserve(sorted_targets.size());
+  for (auto const& name : sorted_targets)
+  {
+    auto const& targ = targets[name];
+    order.emplace(name, modules.size());
+    modules.push_back(&frameworks[targ.fw_idx].modules[targ.mod_idx]);
+  }
+  if (std::ranges::all_of(modules, [](nsmodule const* m) { return m->fetch_builds.empty(); }))
+    return;
+
+  std::vector<std::vector<std::size_t>> dependencies(modules.size());
+  for (std::size_t i = 0; i < modules.size(); ++i)
+  {
+    auto add = [&](auto dep)
+    {
+      auto it = order.find(std::string_view{dep});
+      if (it != order.end() && it->second < i)
+        dependencies[i].push_back(it->second);
+    };
+    modules[i]->foreach_references(add);
+    modules[i]->foreach_dependency(add);
+  }
+
+  nsprofile::span span{"fetch builds"};
+  if (use_jobserver)
+  {
+    // cmake --build reads the same variable when it is not given a job count
+    auto jobs = build_jobs;
+    if (auto level = std::getenv("CMAKE_BUILD_PARALLEL_LEVEL"); level && !jobs)
+      std::from_chars(level, level + std::strlen(level), jobs);
+    jobserver = std::make_shared<nsjobserver>(get_full_cache_dir(), jobs ? jobs : nsparallel::hardware_jobs());
+  }
+  try
+  {
+    nsparallel::for_each_ordered(dependencies, fetch_build_jobs,
+                                 [&](std::size_t i)
+                                 {
+                                   if (modules[i]->fetch_builds.empty())
+                                     return;
+                                   // A job for the build, the nested make or ninja takes the rest from the jobserver
+                                   auto job = jobserver ? jobserver->acquire() : nsjobserver::slot{};
+                                   modules[i]->build_fetches(*this, install_cache);
+                                 });
+  }
+  catch (std::exception&)
+  {
+    jobserver.reset();
+    throw;
+  }
+  jobserver.reset();
+  if (std::ranges::any_of(modules, &nsmodule::was_fetch_rebuilt))
     state.exit_and_rebuild = true;
-  if (mod.has_globs_changed)
-    state.is_dirty = true;
 }
 
+void nsbuild::accumulate_globs(bool unchanged)
+{
+  std::vector<nsglob*>   globs;
+  std::vector<nsmodule*> modules;
+  foreach_module(
+      [&](nsmodule& m)
+      {
+        if (!m.globs_deferred || (!unchanged && !m.globs_needed()))
+          return;
+        m.pending_globs(*this, globs);
+        modules.push_back(&m);
+      });
+
+  nsglob::accumulate(globs, dir_cache.get());
+  for (auto m : modules)
+  {
+    m->update_glob_shas(*this);
+    if (m->has_globs_changed)
+      state.is_dirty = true;
+  }
+}
+
+namespace
+{
+/// @brief lib.so, lib.so.1.2, lib.dylib or lib.dll
+bool is_shared_library(std::string_view name)
+{
+  if (name.ends_with(".dll") || name.ends_with(".DLL") || name.ends_with(".dylib"))
+    return true;
+  auto so = name.rfind(".so");
+  return so != name.npos && std::all_of(name.begin() + so + 3, name.end(),
+                                        [](char c) { return c == '.' || std::isdigit(static_cast<unsigned char>(c)); });
+}
+
+deploy_mode effective_deploy_mode(nspreset const* p)
+{
+  auto mode = p ? p->runtime_deploy : deploy_mode::copy;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+  // DLLs are only looked up next to the executable or on PATH
+  if (mode == deploy_mode::rpath)
+    mode = deploy_mode::hardlink;
+#endif
+  return mode;
+}
+} // namespace
+
 void nsbuild::copy_installed_binaries()
 {
+  namespace fs = std::filesystem;
+
+  nsprofile::span                 span{"copy_installed_binaries"};
   std::array<std::string_view, 2> runtime_loc = {"bin", "lib"};
   auto                            bin         = get_full_rt_dir() / "bin";
-  for (auto const& l : runtime_loc)
+  auto                            mode        = effective_deploy_mode(s_current_preset);
+  auto                            mode_id     = std::to_string(static_cast<int>(mode));
+
+  // Calls l(path, top_path) for every file listed in an install manifest that is deployed to bin
+  auto for_each_listed = [&](std::string const& manifest, auto&& l)
   {
-    namespace fs = std::filesystem;
+    std::ifstream ifs{manifest};
+    std::string   line;
+    while (std::getline(ifs, line))
+    {
+      auto path = fs::path(line).lexically_normal();
+      if (!dll_ext.search(path.filename().generic_string()))
+        continue;
+      if (mode == deploy_mode::rpath && is_shared_library(path.filename().string()))
+        continue;
+      for (auto const& loc : runtime_loc)
+      {
+        auto top_path = get_full_sdk_dir() / loc;
+        auto rel      = path.lexically_relative(top_path);
+        if (!rel.empty() && *rel.begin() != "..")
+        {
+          l(path, top_path);
+          break;
+        }
+      }
+    }
+  };
+
+  auto deploy = [&](fs::path const& path, fs::path const& top_path)
+  {
+    if (!dll_ext.search(path.filename().generic_string()))
+      return;
+    std::error_code ec;
+    auto            dest = bin / path.lexically_relative(top_path);
+    fs::create_directories(dest.parent_path(), ec);
+    deploy_runtime(path, dest);
+  };
+
+  // A file of an installed fetch that is not in bin was deleted since, or was never deployed
+  auto incomplete = [&]()
+  {
+    bool missing = false;
+    for (auto const& [manifest, used] : install_cache.uninstallers)
+    {
+      if (!used)
+        continue;
+      for_each_listed(manifest,
+                      [&](fs::path const& path, fs::path const& top_path)
+                      {
+                        std::error_code ec;
+                        if (!missing && !fs::exists(fs::symlink_status(bin / path.lexically_relative(top_path), ec)))
+                          missing = true;
+                      });
+      if (missing)
+        break;
+    }
+    return missing;
+  };
 
+  // What the last deploy left: the mode, the stat data of every install manifest and the mtime of bin. While it
+  // holds nothing was installed or deleted since, and no manifest or runtime file has to be looked at.
+  auto stamp = [&]()
+  {
+    std::vector<std::string> manifests;
+    for (auto const& [manifest, used] : install_cache.uninstallers)
+      if (used)
+        manifests.push_back(manifest);
+    std::ranges::sort(manifests);
+    auto text = mode_id;
+    for (auto const& m : manifests)
+    {
+      nsstatcache::stamp st;
+      nsstatcache::get_stamp(m, st);
+      text += fmt::format("\n{} {} {} {}", m, st.size, st.mtime_ns, st.inode);
+    }
+    std::error_code ec;
+    auto            mtime = fs::last_write_time(bin, ec);
+    text += fmt::format("\n{}", ec ? 0 : mtime.time_since_epoch().count());
+    return nshash::fast_hex(text);
+  };
+
+  // Only fetches built in this run installed anything new, unless the runtime dir has to be filled from scratch
+  // because it is new, it was deployed with another mode or files are missing from it
+  bool intact = fs::exists(bin) && (state_db->matches("deploy/stamp", stamp()) ||
+                                    (state_db->matches("deploy/mode", mode_id) && !incomplete()));
+  if (intact)
+  {
+    for (auto const& manifest : install_cache.rebuilt)
+      for_each_listed(manifest, deploy);
+    state_db->put("deploy/stamp", stamp());
+    return;
+  }
+
+  for (auto const& l : runtime_loc)
+  {
     auto top_path = get_full_sdk_dir() / l;
     if (!std::filesystem::exists(top_path))
       continue;
-    auto       it           = fs::recursive_directory_iterator{top_path};
-    const auto copy_options = fs::copy_options::update_existing;
+    auto it = fs::recursive_directory_iterator{top_path};
     for (auto const& dir_entry : it)
     {
-      if (!dir_entry.is_regular_file() && !dir_entry.is_symlink())
-        continue;
-      auto name = dir_entry.path().filename().generic_string();
-      bool copy = false;
-      if (std::regex_search(name, dll_ext))
-      {
-        std::error_code ec;
-        auto            path = dir_entry.path();
-        auto            rel  = fs::relative(path, top_path, ec);
-        auto            dest = bin / rel;
-
-        fs::create_directories(dest.parent_path(), ec);
-        std::filesystem::copy(path, dest, copy_options);
-      }
+      if (dir_entry.is_regular_file() || dir_entry.is_symlink())
+        deploy(dir_entry.path(), top_path);
     }
   }
+  state_db->put("deploy/mode", mode_id);
+  state_db->put("deploy/stamp", stamp());
 }
 
 void nsbuild::generate_enum(std::string filepfx, std::string apipfx, std::string from, std::string preset)
@@ -499,61 +863,114 @@ void nsbuild::generate_enum(std::string filepfx, std::string apipfx, std::string
   */
 }
 
-void nsbuild::copy_media(std::filesystem::path from, std::filesystem::path to, std::filesystem::path artefacts,
-                         std::string ignore)
+namespace
 {
-  if (!std::filesystem::exists(from))
-    return;
-  std::filesystem::create_directories(to);
-
-  namespace fs            = std::filesystem;
-  auto       it           = fs::recursive_directory_iterator{from};
-  const auto copy_options = fs::copy_options::update_existing;
+/// @brief Identifies a directory beyond its path, a media dir that was deleted and created again gets a new one.
+/// Always 0 where there are no inodes.
+std::uint64_t dir_inode(std::filesystem::path const& dir)
+{
+#ifdef NS_BUILD_POSIX
+  struct stat sb;
+  if (::stat(dir.c_str(), &sb) == 0)
+    return static_cast<std::uint64_t>(sb.st_ino);
+#endif
+  return 0;
+}
+} // namespace
 
-  std::unordered_set<fs::path> touched;
-  std::unordered_set<fs::path> added;
+void nsbuild::copy_media(std::filesystem::path from, std::filesystem::path to, std::filesystem::path manifest,
+                         std::filesystem::path deployed)
+{
+  namespace fs = std::filesystem;
 
-  if (fs::exists(artefacts))
+  nsmedia_manifest next, last;
+  if (!next.read(manifest))
+    throw std::runtime_error(fmt::format("Missing media manifest {}, run nsbuild --check", manifest.generic_string()));
+  // Without a record of the last deploy every file is checked, unchanged ones are still not copied. The record only
+  // describes the destination it was written for, not one that was deleted or replaced since.
+  if (last.read(deployed) && (!fs::exists(to) || dir_inode(to) != last.target))
+    last.entries.clear();
+
+  std::vector<nsmedia_manifest::entry const*> changed;
+  std::vector<nsmedia_manifest::entry const*> removed;
+  auto                                        l = last.entries.begin();
+  for (auto const& e : next.entries)
   {
-    std::string   spath;
-    std::ifstream ff{artefacts};
-
-    while (!ff.eof())
+    for (; l != last.entries.end() && l->path < e.path; ++l)
+      removed.push_back(&*l);
+    if (l != last.entries.end() && l->path == e.path)
     {
-      std::getline(ff, spath);
-      touched.emplace(spath);
+      if (!l->same_content(e))
+        changed.push_back(&e);
+      ++l;
     }
+    else
+      changed.push_back(&e);
   }
+  for (; l != last.entries.end(); ++l)
+    removed.push_back(&*l);
 
-  for (auto const& dir_entry : it)
+  for (auto e : removed)
   {
-    if (dir_entry.is_directory() && (dir_entry.path().filename() == ignore))
-      continue;
-
-    std::error_code ec       = {};
-    auto const&     path     = dir_entry.path();
-    auto            rel_path = path.lexically_relative(from);
-    auto            dest     = to / rel_path;
-
-    if (dir_entry.is_directory())
-      fs::create_directories(dest, ec);
-    else
-    {
-      fs::copy(path, dest, copy_options);
-      added.emplace(rel_path);
-      touched.erase(rel_path);
-    }
+    std::error_code ec = {};
+    fs::remove(to / e->path, ec);
   }
 
-  for (auto const& file : touched)
+  std::set<fs::path> dirs;
+  for (auto e : changed)
+    dirs.emplace((to / e->path).parent_path());
+  for (auto const& d : dirs)
+    fs::create_directories(d);
+
+  std::array<std::atomic<std::size_t>, 3> counts = {};
+  nsparallel::for_each(changed.size(),
+                       [&](std::size_t i)
+                       {
+                         auto r = nscopy::file(from / changed[i]->path, to / changed[i]->path);
+                         counts[static_cast<std::size_t>(r)]++;
+                       });
+
+  // Recorded only once everything is in place, a failed deploy is retried in full. The files are deployed, failing to
+  // record them only costs a full check next time.
+  std::error_code ec;
+  fs::create_directories(to, ec);
+  next.target = dir_inode(to);
+  if (!next.write(deployed))
   {
-    std::error_code ec = {};
-    fs::remove(to / file, ec);
+    fs::remove(deployed, ec);
+    nslog::warn(fmt::format("Could not record the media deploy in {}", deployed.generic_string()));
   }
 
-  std::ofstream ff{artefacts};
-  for (auto const& file : added)
-    ff << file << std::endl;
+  auto cloned = counts[static_cast<std::size_t>(nscopy::result::cloned)].load();
+  auto copied = counts[static_cast<std::size_t>(nscopy::result::copied)].load();
+  if (cloned || copied || !removed.empty())
+    nslog::print(fmt::format("Media: {} cloned, {} copied, {} removed, {} up to date", cloned, copied, removed.size(),
+                             next.entries.size() - cloned - copied));
+}
+
+void nsbuild::deploy_runtime(std::filesystem::path const& from, std::filesystem::path const& to) const
+{
+  switch (effective_deploy_mode(s_current_preset))
+  {
+  case deploy_mode::copy:
+    nscopy::deploy(from, to, nscopy::link::none);
+    break;
+  case deploy_mode::hardlink:
+    nscopy::deploy(from, to, nscopy::link::hard);
+    break;
+  case deploy_mode::rpath:
+    if (is_shared_library(from.filename().string()))
+    {
+      // A copy left by another mode would be loaded instead of the library in the sdk
+      std::error_code ec;
+      std::filesystem::remove(to, ec);
+      break;
+    }
+    [[fallthrough]];
+  case deploy_mode::symlink:
+    nscopy::deploy(from, to, nscopy::link::symbolic);
+    break;
+  }
 }
 
 modid nsbuild::get_modid(std::string_view path) const
@@ -593,6 +1010,8 @@ void nsbuild::compute_paths(std::string const& preset)
   paths.out_dir  = fs::canonical(paths.out_dir);
   paths.cfg_dir  = fs::canonical(paths.cfg_dir);
   paths.dl_dir   = fs::canonical(paths.dl_dir);
+  // Created when the first entry is stored
+  paths.bincache_dir = binary_cache_dir.empty() ? fs::path{} : (paths.out_dir / binary_cache_dir).lexically_normal();
 
   if (!preset_name.empty())
   {
@@ -634,6 +1053,7 @@ void nsbuild::write_include_modules() const
 {
   if (!state.is_dirty)
     return;
+  nsprofile::span span{"write_include_modules"};
 
   auto          cmlf = get_full_cfg_dir() / cmake_gen_dir / "CMakeLists.txt";
   std::ofstream ofs{cmlf};
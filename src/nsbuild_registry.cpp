@@ -1,5 +1,7 @@
 #include "nscmdcommon.h"
+#include "nslog.h"
 
+#include <charconv>
 #include <fstream>
 
 void halt();
@@ -94,13 +96,8 @@ void collect_content(neo::text_content const& src, std::filesystem::path root, n
 
           if (!name.empty() && !value.empty())
           {
-            name      = trim(name);
-            auto file = std::ifstream(root / trim(value), std::ios::binary);
-            if (file.is_open())
-            {
-              content.emplace_back(
-                  name, value, std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()));
-            }
+            name = trim(name);
+            content.emplace_back(name, value, root / trim(value));
           }
           name  = {};
           value = {};
@@ -214,6 +211,54 @@ ns_cmd_handler(has_fmtlib, build, state, cmd)
   return neo::retcode::e_success;
 }
 
+ns_cmd_handler(parallel_scan, build, state, cmd)
+{
+  build.parallel_scan = to_bool(get_idx_param(cmd, 0));
+  return neo::retcode::e_success;
+}
+
+ns_cmd_handler(fetch_jobs, build, state, cmd)
+{
+  auto value = get_idx_param(cmd, 0);
+  auto r     = std::from_chars(value.data(), value.data() + value.size(), build.fetch_jobs);
+  if (r.ec != std::errc{} || !build.fetch_jobs)
+  {
+    nslog::warn(fmt::format("Invalid fetch_jobs {}, downloading one fetch at a time", value));
+    build.fetch_jobs = 1;
+  }
+  return neo::retcode::e_success;
+}
+
+ns_cmd_handler(fetch_build_jobs, build, state, cmd)
+{
+  auto value = get_idx_param(cmd, 0);
+  auto r     = std::from_chars(value.data(), value.data() + value.size(), build.fetch_build_jobs);
+  if (r.ec != std::errc{} || !build.fetch_build_jobs)
+  {
+    nslog::warn(fmt::format("Invalid fetch_build_jobs {}, building one fetch at a time", value));
+    build.fetch_build_jobs = 1;
+  }
+  return neo::retcode::e_success;
+}
+
+ns_cmd_handler(build_jobs, build, state, cmd)
+{
+  auto value = get_idx_param(cmd, 0);
+  auto r     = std::from_chars(value.data(), value.data() + value.size(), build.build_jobs);
+  if (r.ec != std::errc{})
+  {
+    nslog::warn(fmt::format("Invalid build_jobs {}, using the core count", value));
+    build.build_jobs = 0;
+  }
+  return neo::retcode::e_success;
+}
+
+ns_cmd_handler(jobserver, build, state, cmd)
+{
+  build.use_jobserver = to_bool(get_idx_param(cmd, 0));
+  return neo::retcode::e_success;
+}
+
 ns_cmd_handler(macro, build, state, cmd)
 {
   auto name                       = get_idx_param(cmd, 0);
@@ -274,6 +319,22 @@ ns_cmd_handler(glob_sources, build, state, cmd)
   return neo::retcode::e_success;
 }
 
+ns_cmd_handler(runtime_deploy, build, state, cmd)
+{
+  auto mode = get_idx_param(cmd, 0);
+  if (mode == "copy")
+    build.s_nspreset->runtime_deploy = deploy_mode::copy;
+  else if (mode == "hardlink")
+    build.s_nspreset->runtime_deploy = deploy_mode::hardlink;
+  else if (mode == "symlink")
+    build.s_nspreset->runtime_deploy = deploy_mode::symlink;
+  else if (mode == "rpath")
+    build.s_nspreset->runtime_deploy = deploy_mode::rpath;
+  else
+    nslog::warn(fmt::format("Unknown runtime_deploy {} in preset {}, copying", mode, build.s_nspreset->name));
+  return neo::retcode::e_success;
+}
+
 ns_cmd_handler(unity_build, build, state, cmd)
 {
   build.s_nspreset->unity_build = to_bool(get_idx_param(cmd, 0));
@@ -341,6 +402,12 @@ ns_cmd_handler(download_dir, build, state, cmd)
   return neo::retcode::e_success;
 }
 
+ns_cmd_handler(binary_cache_dir, build, state, cmd)
+{
+  build.binary_cache_dir = get_idx_param(cmd, 0);
+  return neo::retcode::e_success;
+}
+
 ns_cmd_handler(cmake_gen_dir, build, state, cmd)
 {
   build.cmake_gen_dir = get_idx_param(cmd, 0);
@@ -527,8 +594,8 @@ ns_star_handler(var, build, state, cmd)
 {
   auto& m = *build.s_nsvar;
   m.params.emplace_back();
-  m.params.back().name   = cmd.name();
-  m.params.back().params = cmd.params();
+  m.params.back().name = cmd.name();
+  cmake::values(m.params.back().values, cmd.params().value().begin(), cmd.params().value().end());
   return neo::retcode::e_success;
 }
 
@@ -716,6 +783,12 @@ ns_cmd_handler(tag, build, state, cmd)
   return neo::retcode::e_success;
 }
 
+ns_cmd_handler(commit, build, state, cmd)
+{
+  build.s_nsfetch->commit = get_idx_param(cmd, 0);
+  return neo::retcode::e_success;
+}
+
 ns_cmd_handler(test_tag, build, state, cmd)
 {
   build.test_tags += get_idx_param(cmd, 0);
@@ -984,6 +1057,11 @@ ns_registry(nsbuild)
   ns_cmd(version);
   ns_cmd(verbose);
   ns_cmd(has_fmtlib);
+  ns_cmd(parallel_scan);
+  ns_cmd(fetch_jobs);
+  ns_cmd(fetch_build_jobs);
+  ns_cmd(build_jobs);
+  ns_cmd(jobserver);
   ns_cmd(sdk_dir);
   ns_cmd(cmake_gen_dir);
   ns_cmd(frameworks_dir);
@@ -993,6 +1071,7 @@ ns_registry(nsbuild)
   ns_cmd(out_dir);
   ns_cmd(build_dir);
   ns_cmd(download_dir);
+  ns_cmd(binary_cache_dir);
   ns_cmd(macro);
   ns_cmd(plugin_dir);
   ns_cmd(media_name);
@@ -1011,6 +1090,7 @@ ns_registry(nsbuild)
     ns_cmd(cppcheck);
     ns_cmd(cppcheck_suppression);
     ns_cmd(unity_build);
+    ns_cmd(runtime_deploy);
     ns_cmd(naming);
     ns_cmd(tag);
     ns_cmd(platform);
@@ -1082,6 +1162,7 @@ ns_registry(nsbuild)
     ns_cmd(force_build);
     ns_cmd(force_download);
     ns_cmd(tag);
+    ns_cmd(commit);
     ns_scope_def(args) { ns_star(var); }
     ns_cmd(package);
     ns_cmd(components);
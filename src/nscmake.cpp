@@ -46,6 +46,38 @@ std::string value(nsparams const& params, char sep)
   return result;
 }
 
+void values(std::vector<std::string_view>& result, neo::list::vector::const_iterator b,
+            neo::list::vector::const_iterator e)
+{
+  for (auto it = b; it != e; ++it)
+  {
+    auto const& p = *it;
+    switch (p.index())
+    {
+    case neo::command::param_esq_string:
+    case neo::command::param_single:
+    {
+      result.emplace_back(neo::command::as_string(p));
+    }
+    break;
+    case neo::command::param_list:
+    {
+      auto const& l = std::get<neo::list>(p);
+      values(result, l.begin(), l.end());
+    }
+    break;
+    }
+  }
+}
+
+std::string value(std::vector<std::string_view> const& vals, char sep)
+{
+  std::string result;
+  for (auto v : vals)
+    append(result, v, sep);
+  return result;
+}
+
 std::string path(std::filesystem::path const& path) 
 { 
   auto ret = path.generic_string(); 
@@ -0,0 +1,164 @@
+#include "nscopy.h"
+
+#include "nsmmap.h"
+#include "nsprofile.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace nscopy
+{
+namespace
+{
+namespace fs = std::filesystem;
+
+bool same_content(fs::path const& a, fs::path const& b)
+{
+  nsmapped_file fa, fb;
+  return fa.open(a) && fb.open(b) && fa.view() == fb.view();
+}
+
+#ifdef __linux__
+/// @brief Closes the descriptor when it goes out of scope
+struct fd_guard
+{
+  int fd = -1;
+  ~fd_guard()
+  {
+    if (fd >= 0)
+      ::close(fd);
+  }
+};
+
+/// @brief Clones from into to, or copies it in the kernel. False when neither is supported between the two files.
+bool clone_or_copy(fs::path const& from, fs::path const& to, result& r)
+{
+  auto fail = [&](char const* what) { throw fs::filesystem_error(what, from, to, {errno, std::generic_category()}); };
+
+  fd_guard in{::open(from.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (in.fd < 0)
+    fail("Cannot open source");
+  struct stat st;
+  if (::fstat(in.fd, &st) != 0)
+    fail("Cannot stat source");
+  fd_guard out{::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777)};
+  if (out.fd < 0)
+    fail("Cannot create destination");
+
+  if (::ioctl(out.fd, FICLONE, in.fd) == 0)
+  {
+    r = result::cloned;
+    return true;
+  }
+
+  auto left = static_cast<std::size_t>(st.st_size);
+  while (left)
+  {
+    auto n = ::copy_file_range(in.fd, nullptr, out.fd, nullptr, left, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && left == static_cast<std::size_t>(st.st_size) &&
+        (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+      return false;
+    if (n < 0)
+      fail("Cannot copy");
+    // The source shrank while copying
+    if (n == 0)
+      break;
+    left -= static_cast<std::size_t>(n);
+  }
+  nsprofile::touch(static_cast<std::uint64_t>(st.st_size));
+  r = result::copied;
+  return true;
+}
+#endif
+} // namespace
+
+result file(fs::path const& from, fs::path const& to)
+{
+  auto size  = fs::file_size(from);
+  auto mtime = fs::last_write_time(from);
+
+  std::error_code ec;
+  if (fs::is_regular_file(to, ec) && fs::file_size(to, ec) == size && !ec)
+  {
+    if (fs::last_write_time(to, ec) == mtime && !ec)
+      return result::unchanged;
+    // Timestamps change with a branch switch while content usually does not
+    if (same_content(from, to))
+    {
+      fs::last_write_time(to, mtime, ec);
+      return result::unchanged;
+    }
+  }
+
+  // Written aside and renamed over so a running program never sees half a file
+  auto tmp = to;
+  tmp += ".nscopy";
+  auto r   = result::copied;
+  try
+  {
+#ifdef __linux__
+    if (!clone_or_copy(from, tmp, r))
+      fs::copy_file(from, tmp, fs::copy_options::overwrite_existing);
+#else
+    fs::copy_file(from, tmp, fs::copy_options::overwrite_existing);
+#endif
+    fs::last_write_time(tmp, mtime);
+    fs::rename(tmp, to);
+  }
+  catch (...)
+  {
+    // A partial copy must not be left next to the destination
+    fs::remove(tmp, ec);
+    throw;
+  }
+  return r;
+}
+
+result deploy(fs::path const& from, fs::path const& to, link kind)
+{
+  std::error_code ec;
+  auto            status = fs::symlink_status(to, ec);
+  bool            exists = fs::exists(status);
+  bool            linked = exists && (fs::is_symlink(status) || fs::equivalent(from, to, ec));
+
+  if (kind == link::symbolic && fs::is_symlink(status))
+  {
+    auto target = fs::read_symlink(to, ec);
+    if (!ec && fs::equivalent(to.parent_path() / target, from, ec))
+      return result::unchanged;
+  }
+  else if (kind == link::hard && exists && !fs::is_symlink(status) && fs::equivalent(from, to, ec))
+    return result::unchanged;
+  // A link left by another mode would make the copy look current, or be written through
+  else if (kind == link::none && !linked)
+    return file(from, to);
+
+  if (exists)
+    fs::remove(to);
+  if (kind == link::symbolic)
+  {
+    // Relative, so the output directory can be moved
+    auto target = from.lexically_relative(to.parent_path());
+    fs::create_symlink(target.empty() ? from : target, to, ec);
+  }
+  else if (kind == link::hard)
+  {
+    // A link to the file itself, sdk symlinks point to names that may not be deployed
+    auto target = fs::canonical(from, ec);
+    if (!ec)
+      fs::create_hard_link(target, to, ec);
+  }
+  if (kind == link::none || ec)
+    return file(from, to);
+  return result::linked;
+}
+
+} // namespace nscopy
@@ -0,0 +1,145 @@
+#include "nsdircache.h"
+
+#include "nsprofile.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__))
+#include <sys/stat.h>
+#define NS_POSIX_STAT
+#endif
+
+namespace
+{
+constexpr char k_header[] = "nsdircache 1";
+// A directory changed within the same mtime tick as its listing may have changed after it, it is not trusted
+constexpr std::int64_t k_racy_window_ns = 2'000'000'000;
+
+std::int64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+bool nsdircache::get_stamp(std::filesystem::path const& path, stamp& st)
+{
+#ifdef NS_POSIX_STAT
+  struct stat sb;
+  if (::stat(path.c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode))
+    return false;
+#ifdef __APPLE__
+  auto const& mtime = sb.st_mtimespec;
+#else
+  auto const& mtime = sb.st_mtim;
+#endif
+  st.mtime_ns = static_cast<std::int64_t>(mtime.tv_sec) * 1'000'000'000 + mtime.tv_nsec;
+  st.inode    = static_cast<std::uint64_t>(sb.st_ino);
+  return true;
+#else
+  std::error_code ec;
+  auto            mtime = std::filesystem::last_write_time(path, ec);
+  if (ec)
+    return false;
+  st.mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count();
+  st.inode    = 0;
+  return true;
+#endif
+}
+
+void nsdircache::load(std::filesystem::path const& path)
+{
+  std::scoped_lock guard{lock};
+  start_ns = now_ns();
+  // Already in memory, a resident nsbuild keeps the listings between checks
+  if (loaded == path)
+    return;
+  dirs.clear();
+  loaded = path;
+
+  std::ifstream file(path);
+  std::string   line;
+  if (!std::getline(file, line) || line != k_header)
+    return;
+  while (std::getline(file, line))
+  {
+    std::istringstream iss(line);
+    listing            l;
+    std::size_t        count = 0;
+    iss >> l.st.mtime_ns >> l.st.inode >> count;
+    iss.get();
+    std::string name;
+    std::getline(iss, name);
+    if (iss.fail() || name.empty())
+      return;
+
+    std::vector<entry> content;
+    content.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      if (!std::getline(file, line) || line.size() < 2 || (line[0] != 'd' && line[0] != 'f'))
+        return;
+      content.push_back({line.substr(1), line[0] == 'd'});
+    }
+    l.content             = std::make_shared<std::vector<entry> const>(std::move(content));
+    dirs[std::move(name)] = std::move(l);
+  }
+}
+
+void nsdircache::save(std::filesystem::path const& path, bool prune) const
+{
+  std::ofstream file(path);
+  if (!file.is_open())
+    return;
+
+  file << k_header << "\n";
+  for (auto const& d : dirs)
+  {
+    if (prune && !d.second.used)
+      continue;
+    file << d.second.st.mtime_ns << " " << d.second.st.inode << " " << d.second.content->size() << " " << d.first
+         << "\n";
+    for (auto const& e : *d.second.content)
+      file << (e.is_dir ? 'd' : 'f') << e.name << "\n";
+  }
+}
+
+nsdircache::entries nsdircache::list(std::filesystem::path const& dir)
+{
+  stamp st;
+  bool  has_stamp = get_stamp(dir, st);
+  auto  name      = dir.generic_string();
+  if (has_stamp)
+  {
+    std::scoped_lock guard{lock};
+    auto             it = dirs.find(name);
+    if (it != dirs.end() && it->second.st == st)
+    {
+      nsprofile::touch();
+      it->second.used = true;
+      return it->second.content;
+    }
+  }
+
+  std::vector<entry> content;
+  bool               cacheable = has_stamp;
+  for (auto const& it : std::filesystem::directory_iterator(dir))
+  {
+    auto leaf = it.path().filename().string();
+    // The listing is stored one name per line
+    cacheable &= leaf.find('\n') == std::string::npos;
+    content.push_back({std::move(leaf), it.is_directory()});
+  }
+  nsprofile::touch(0, content.size() + 1);
+  auto result = std::make_shared<std::vector<entry> const>(std::move(content));
+
+  // Listed within the racy window, an entry added in the same mtime tick would go unnoticed next time
+  std::scoped_lock guard{lock};
+  if (cacheable && st.mtime_ns < (start_ns ? start_ns : now_ns()) - k_racy_window_ns)
+    dirs[name] = listing{st, result, true};
+  else
+    dirs.erase(name);
+  return result;
+}
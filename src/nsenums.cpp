@@ -1,6 +1,7 @@
 #include "nsenums.h"
 
 #include "nsbuild.h"
+#include "nsmatch.h"
 
 #include <fstream>
 #include <regex>
@@ -69,10 +70,19 @@ std::string nsenum_context::prefix_words(std::string const& pref, std::string co
     return pref + sentence;
   else
   {
+    static nsmatcher const words("\\w+");
+
     std::string result;
-    std::string replace = fmt::format("{}$&", pref);
-    std::regex  re("\\w+");
-    return std::regex_replace(sentence, re, replace);
+    std::size_t pos = 0, start = 0, length = 0;
+    while (words.find(sentence, start, length, pos))
+    {
+      result.append(sentence, pos, start - pos);
+      result += pref;
+      result.append(sentence, start, length);
+      pos = start + length;
+    }
+    result.append(sentence, pos);
+    return result;
   }
 }
 
@@ -0,0 +1,129 @@
+#include "nsfileset.h"
+
+#include <algorithm>
+
+namespace
+{
+/// @brief Byte of a path in sort order, the separator goes before any other character so a directory sorts as one
+/// element: "a/b" < "a-b"
+inline int rank(char c) { return c == nsfileset::separator ? 0 : static_cast<unsigned char>(c) + 1; }
+
+/// @brief Compares dir + separator + leaf of two files without joining them
+bool less(std::string_view a_dir, std::string_view a_leaf, std::string_view b_dir, std::string_view b_leaf)
+{
+  auto        a_size = a_dir.size() + 1 + a_leaf.size();
+  auto        b_size = b_dir.size() + 1 + b_leaf.size();
+  auto        at     = [](std::string_view d, std::string_view l, std::size_t i)
+  { return i < d.size() ? d[i] : (i == d.size() ? nsfileset::separator : l[i - d.size() - 1]); };
+  std::size_t i = std::mismatch(a_dir.begin(), a_dir.end(), b_dir.begin(), b_dir.end()).first - a_dir.begin();
+  for (auto n = std::min(a_size, b_size); i < n; ++i)
+  {
+    auto ca = rank(at(a_dir, a_leaf, i));
+    auto cb = rank(at(b_dir, b_leaf, i));
+    if (ca != cb)
+      return ca < cb;
+  }
+  return a_size < b_size;
+}
+} // namespace
+
+nsfileset::range nsfileset::store(std::string_view s)
+{
+  range r{static_cast<std::uint32_t>(buffer.size()), static_cast<std::uint32_t>(s.size())};
+  buffer.append(s);
+  return r;
+}
+
+std::uint32_t nsfileset::add_dir(std::string_view dir)
+{
+  // The root keeps no separator either, files are joined with one
+  while (!dir.empty() && dir.back() == separator)
+    dir.remove_suffix(1);
+  dirs.push_back(store(dir));
+  return static_cast<std::uint32_t>(dirs.size() - 1);
+}
+
+void nsfileset::add(std::uint32_t dir, std::string_view leaf) { files.push_back({dir, store(leaf)}); }
+
+void nsfileset::append(nsfileset const& other)
+{
+  auto offset = static_cast<std::uint32_t>(buffer.size());
+  auto base   = static_cast<std::uint32_t>(dirs.size());
+  buffer.append(other.buffer);
+  for (auto d : other.dirs)
+    dirs.push_back({d.offset + offset, d.size});
+  for (auto f : other.files)
+    files.push_back({f.dir + base, {f.leaf.offset + offset, f.leaf.size}});
+}
+
+void nsfileset::sort()
+{
+  // Directories are ranked once, files of unrelated directories then compare by rank. Files directly in a directory
+  // interleave with its subdirectories ("a/b/c" < "a/d"), those alone are compared byte by byte.
+  std::vector<std::uint32_t> order(dirs.size());
+  for (std::uint32_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::ranges::sort(order, [this](std::uint32_t a, std::uint32_t b)
+                    { return less(view(dirs[a]), {}, view(dirs[b]), {}); });
+
+  struct dir_rank
+  {
+    std::uint32_t rank   = 0;
+    bool          nested = false;
+  };
+  std::vector<dir_rank> ranks(dirs.size());
+  for (std::uint32_t i = 0, rank = 0; i < order.size(); ++i)
+  {
+    auto dir = view(dirs[order[i]]);
+    if (i && dir != view(dirs[order[i - 1]]))
+      ++rank;
+    ranks[order[i]].rank = rank;
+    // Subdirectories sort right after their parent
+    for (auto j = i + 1; j < order.size(); ++j)
+    {
+      auto next = view(dirs[order[j]]);
+      if (next == dir)
+        continue;
+      ranks[order[i]].nested = next.size() > dir.size() && next.starts_with(dir) && next[dir.size()] == separator;
+      break;
+    }
+  }
+
+  std::ranges::sort(files,
+                    [&](file const& a, file const& b)
+                    {
+                      auto ra = ranks[a.dir];
+                      auto rb = ranks[b.dir];
+                      if (ra.rank == rb.rank)
+                        return view(a.leaf) < view(b.leaf);
+                      if (!(ra.rank < rb.rank ? ra : rb).nested)
+                        return ra.rank < rb.rank;
+                      return less(view(dirs[a.dir]), view(a.leaf), view(dirs[b.dir]), view(b.leaf));
+                    });
+}
+
+std::size_t nsfileset::memory() const
+{
+  return buffer.capacity() + dirs.capacity() * sizeof(range) + files.capacity() * sizeof(file);
+}
+
+std::vector<std::string> nsfileset::relative_dirs(std::filesystem::path const& base) const
+{
+  auto                     normal_base = base.lexically_normal();
+  std::vector<std::string> prefixes;
+  prefixes.reserve(dirs.size());
+  for (auto d : dirs)
+  {
+    std::filesystem::path dir = view(d).empty() ? std::string_view{&separator, 1} : view(d);
+    auto                  rel = base.empty() ? dir : dir.lexically_relative(normal_base);
+    if (rel.empty())
+      rel = dir;
+    auto prefix = rel.generic_string();
+    if (prefix == ".")
+      prefix.clear();
+    else if (!prefix.ends_with('/'))
+      prefix += '/';
+    prefixes.emplace_back(std::move(prefix));
+  }
+  return prefixes;
+}
@@ -1,10 +1,11 @@
 
-#include "picosha2.h"
-
 #include <algorithm>
 #include <nscmake.h>
 #include <nscmake_conststr.h>
 #include <nsglob.h>
+#include <nshash.h>
+#include <nsparallel.h>
+#include <nsprofile.h>
 
 void nsglob::print(std::ostream& oss, std::string_view name) const
 {
@@ -26,56 +27,117 @@ void nsglob::print(std::ostream& oss, std::string_view name, std::string_view ct
                    std::filesystem::path const& relative_to) const
 {
   oss << "\nset(" << name;
-  for (auto& sp : sub_paths)
-  {
-    for (auto const& s : files)
-    {
-      if (!relative_to.empty())
-        oss << "\n\t" << ctx << cmake::path(std::filesystem::relative(s, relative_to));
-      else
-        oss << "\n\t" << ctx << cmake::path(s);
-    }
-  }
+  // Directories are made relative once, files only append their leaf
+  files.for_each_relative(relative_to,
+                          [&](std::string_view dir, std::string_view leaf)
+                          { oss << "\n\t" << ctx << dir << leaf; });
 
   oss << "\n)";
 }
 
-void nsglob::accumulate()
+namespace
+{
+struct walk_task
+{
+  nsglob*               glob  = nullptr;
+  std::uint32_t         index = 0;
+  std::filesystem::path dir;
+};
+
+/// @brief What one worker found, files are kept per glob and merged into them after the walk
+struct walk_result
+{
+  std::vector<nsglob::file_set>                          files;
+  std::vector<std::pair<nsglob*, std::filesystem::path>> dirs;
+  std::uint64_t                                          touched = 0;
+};
+
+/// @brief Extension as path::extension gives it, without building a path
+std::string extension(std::string const& leaf)
 {
-  std::string content;
-  for (auto& s : sub_paths)
+  auto dot = leaf.rfind('.');
+  if (dot == std::string::npos || dot == 0 || leaf == "..")
+    return {};
+  return leaf.substr(dot);
+}
+} // namespace
+
+void nsglob::accumulate() { accumulate(std::vector<nsglob*>{this}); }
+
+void nsglob::accumulate(std::vector<nsglob*> const& globs, nsdircache* cache)
+{
+  nsprofile::span span{"nsglob::accumulate", nsprofile::enabled() ? fmt::format("{} globs", globs.size()) : ""};
+
+  nsparallel::work_stealing<walk_task> pool;
+  for (std::uint32_t i = 0; i < globs.size(); ++i)
   {
-    if (std::filesystem::exists(s))
+    for (auto const& s : globs[i]->sub_paths)
     {
-      process_directory(files, std::filesystem::directory_entry(s));
+      // Entries joined to a normal path stay normal, only the roots need it
+      if (std::filesystem::exists(s))
+        pool.push({globs[i], i, std::filesystem::absolute(s).lexically_normal()});
     }
   }
-  std::ranges::sort(files);
-  for (auto const& p : files)
+
+  std::vector<walk_result> results(pool.size());
+  for (auto& r : results)
+    r.files.resize(globs.size());
+  pool.run(
+      [&results, cache](walk_task task, auto& worker)
+      {
+        auto& g = *task.glob;
+        if (!g.path_exclude_filters.empty() && g.path_exclude_filters == task.dir.stem().string())
+          return;
+        auto& out = results[worker.index()];
+        out.dirs.emplace_back(task.glob, task.dir);
+
+        auto& files = out.files[task.index];
+        auto  dir   = files.add_dir(task.dir.native());
+        auto  add   = [&](std::string const& leaf, bool is_dir)
+        {
+          if (is_dir && g.recurse)
+            worker.push({task.glob, task.index, task.dir / leaf});
+          else if (!g.file_filters || g.file_filters->contains(extension(leaf)))
+            files.add(dir, leaf);
+        };
+        if (cache)
+        {
+          auto listing = cache->list(task.dir);
+          for (auto const& e : *listing)
+            add(e.name, e.is_dir);
+          return;
+        }
+        out.touched++;
+        for (auto const& it : std::filesystem::directory_iterator(task.dir))
+        {
+          out.touched++;
+          add(it.path().filename().string(), it.is_directory());
+        }
+      });
+
+  for (auto& r : results)
   {
-    content += p.string();
-    content += "\n";
+    for (std::uint32_t i = 0; i < globs.size(); ++i)
+      globs[i]->files.append(r.files[i]);
+    for (auto& d : r.dirs)
+      d.first->dirs.emplace_back(std::move(d.second));
+    nsprofile::touch(0, r.touched);
   }
-  picosha2::hash256_hex_string(content, sha);
-}
 
-void nsglob::process_directory(file_set& set, std::filesystem::directory_entry const& de)
-{
-  if (!path_exclude_filters.empty() && path_exclude_filters == de.path().stem().string())
-    return;
-  auto rdit = std::filesystem::directory_iterator(de);
-  for (auto const& it : rdit)
+  // Workers finish in any order, sorting keeps the file list and its sha as they were with a serial walk
+  for (auto g : globs)
   {
-    if (it.is_directory() && recurse)
-      process_directory(set, it);
-    else
-      process_entry(set, it);
+    g->files.sort();
+    std::ranges::sort(g->dirs);
+    std::string content;
+    g->files.for_each(
+        [&content](std::string_view dir, std::string_view leaf)
+        {
+          content += dir;
+          content += nsfileset::separator;
+          content += leaf;
+          content += "\n";
+        });
+    g->sha = nshash::fast_hex(content);
   }
 }
-
-void nsglob::process_entry(file_set& set, std::filesystem::directory_entry const& de)
-{
-  if (file_filters && !file_filters->contains(de.path().extension().string()))
-    return;
-  set.emplace_back(std::filesystem::absolute(de.path()).lexically_normal());
-}
@@ -0,0 +1,265 @@
+#include "nshash.h"
+
+#include "picosha2.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NS_HASH_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define NS_TARGET_SHA
+#else
+#include <cpuid.h>
+#define NS_TARGET_SHA __attribute__((target("sha,sse4.1")))
+#endif
+#include <immintrin.h>
+#endif
+
+namespace nshash
+{
+namespace
+{
+// wyhash final 4, public domain (Wang Yi)
+constexpr std::uint64_t k_secret[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull,
+                                       0x4d5a2da51de1aa47ull};
+
+inline void mum(std::uint64_t& a, std::uint64_t& b)
+{
+#if defined(_MSC_VER) && defined(_M_X64) && !defined(__clang__)
+  a = _umul128(a, b, &b);
+#elif defined(__SIZEOF_INT128__)
+  __uint128_t r = a;
+  r *= b;
+  a = static_cast<std::uint64_t>(r);
+  b = static_cast<std::uint64_t>(r >> 64);
+#else
+  std::uint64_t ha = a >> 32, hb = b >> 32, la = static_cast<std::uint32_t>(a), lb = static_cast<std::uint32_t>(b);
+  std::uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32);
+  std::uint64_t c = t < rl;
+  std::uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  a = lo;
+  b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+inline std::uint64_t mix(std::uint64_t a, std::uint64_t b)
+{
+  mum(a, b);
+  return a ^ b;
+}
+
+// Little endian hosts only, which is every platform nsbuild targets
+inline std::uint64_t r8(std::uint8_t const* p)
+{
+  std::uint64_t v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+
+inline std::uint64_t r4(std::uint8_t const* p)
+{
+  std::uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+inline std::uint64_t r3(std::uint8_t const* p, std::size_t k)
+{
+  return (static_cast<std::uint64_t>(p[0]) << 16) | (static_cast<std::uint64_t>(p[k >> 1]) << 8) | p[k - 1];
+}
+
+constexpr std::array<std::uint32_t, 64> k_sha256_k = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#ifdef NS_HASH_X86
+bool detect_sha_ni()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+  int regs[4];
+  __cpuid(regs, 0);
+  if (regs[0] < 7)
+    return false;
+  __cpuid(regs, 1);
+  bool sse41 = (regs[2] & (1 << 19)) != 0;
+  __cpuidex(regs, 7, 0);
+  return sse41 && (regs[1] & (1 << 29)) != 0;
+#else
+  unsigned a = 0, b = 0, c = 0, d = 0;
+  if (!__get_cpuid(1, &a, &b, &c, &d))
+    return false;
+  bool sse41 = (c & bit_SSE4_1) != 0;
+  if (!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+    return false;
+  return sse41 && (b & (1u << 29)) != 0;
+#endif
+}
+
+NS_TARGET_SHA void sha256_ni_blocks(std::uint32_t state[8], std::uint8_t const* data, std::size_t blocks)
+{
+  __m128i const mask = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+
+  __m128i tmp    = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&state[0]));
+  __m128i state1 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&state[4]));
+  tmp            = _mm_shuffle_epi32(tmp, 0xB1);       // CDAB
+  state1         = _mm_shuffle_epi32(state1, 0x1B);    // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);    // ABEF
+  state1         = _mm_blend_epi16(state1, tmp, 0xF0); // CDGH
+
+  for (; blocks; --blocks, data += 64)
+  {
+    __m128i abef = state0;
+    __m128i cdgh = state1;
+    __m128i w[16];
+    for (int q = 0; q < 16; ++q)
+    {
+      if (q < 4)
+        w[q] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(data + q * 16)), mask);
+      else
+        w[q] = _mm_sha256msg2_epu32(
+            _mm_add_epi32(_mm_sha256msg1_epu32(w[q - 4], w[q - 3]), _mm_alignr_epi8(w[q - 1], w[q - 2], 4)),
+            w[q - 1]);
+      __m128i msg = _mm_add_epi32(w[q], _mm_loadu_si128(reinterpret_cast<__m128i const*>(&k_sha256_k[q * 4])));
+      state1      = _mm_sha256rnds2_epu32(state1, state0, msg);
+      msg         = _mm_shuffle_epi32(msg, 0x0E);
+      state0      = _mm_sha256rnds2_epu32(state0, state1, msg);
+    }
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+
+  tmp    = _mm_shuffle_epi32(state0, 0x1B);    // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xB1);    // DCHG
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0); // DCBA
+  state1 = _mm_alignr_epi8(state1, tmp, 8);    // ABEF
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+std::string sha256_ni_hex(std::string_view data)
+{
+  std::uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+  auto p    = reinterpret_cast<std::uint8_t const*>(data.data());
+  auto full = data.size() / 64;
+  sha256_ni_blocks(state, p, full);
+
+  // Padding: 0x80, zeros, then the bit length big endian, in one or two blocks
+  std::uint8_t tail[128] = {};
+  auto         rem       = data.size() % 64;
+  std::memcpy(tail, p + full * 64, rem);
+  tail[rem]        = 0x80;
+  std::size_t len  = rem < 56 ? 64 : 128;
+  auto        bits = static_cast<std::uint64_t>(data.size()) * 8;
+  for (int i = 0; i < 8; ++i)
+    tail[len - 1 - i] = static_cast<std::uint8_t>(bits >> (i * 8));
+  sha256_ni_blocks(state, tail, len / 64);
+
+  static constexpr char digits[] = "0123456789abcdef";
+  std::string           out(64, '0');
+  for (int i = 0; i < 8; ++i)
+  {
+    for (int n = 0; n < 8; ++n)
+      out[i * 8 + n] = digits[(state[i] >> (28 - n * 4)) & 0xF];
+  }
+  return out;
+}
+#endif
+} // namespace
+
+std::uint64_t fast(std::string_view data, std::uint64_t seed)
+{
+  auto        p   = reinterpret_cast<std::uint8_t const*>(data.data());
+  std::size_t len = data.size();
+  seed ^= mix(seed ^ k_secret[0], k_secret[1]);
+  std::uint64_t a, b;
+  if (len <= 16)
+  {
+    if (len >= 4)
+    {
+      a = (r4(p) << 32) | r4(p + ((len >> 3) << 2));
+      b = (r4(p + len - 4) << 32) | r4(p + len - 4 - ((len >> 3) << 2));
+    }
+    else if (len > 0)
+    {
+      a = r3(p, len);
+      b = 0;
+    }
+    else
+      a = b = 0;
+  }
+  else
+  {
+    std::size_t i = len;
+    if (i >= 48)
+    {
+      std::uint64_t see1 = seed, see2 = seed;
+      do
+      {
+        seed = mix(r8(p) ^ k_secret[1], r8(p + 8) ^ seed);
+        see1 = mix(r8(p + 16) ^ k_secret[2], r8(p + 24) ^ see1);
+        see2 = mix(r8(p + 32) ^ k_secret[3], r8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      }
+      while (i >= 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16)
+    {
+      seed = mix(r8(p) ^ k_secret[1], r8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = r8(p + i - 16);
+    b = r8(p + i - 8);
+  }
+  a ^= k_secret[1];
+  b ^= seed;
+  mum(a, b);
+  return mix(a ^ k_secret[0] ^ len, b ^ k_secret[1]);
+}
+
+std::string fast_hex(std::string_view data)
+{
+  static constexpr char digits[] = "0123456789abcdef";
+
+  auto        h = fast(data);
+  std::string out(16, '0');
+  for (int i = 15; i >= 0; --i, h >>= 4)
+    out[i] = digits[h & 0xF];
+  return out;
+}
+
+bool has_sha_ni()
+{
+#ifdef NS_HASH_X86
+  static bool const value = detect_sha_ni();
+  return value;
+#else
+  return false;
+#endif
+}
+
+std::string sha256_hex(std::string_view data)
+{
+#ifdef NS_HASH_X86
+  if (has_sha_ni())
+    return sha256_ni_hex(data);
+#endif
+  std::string sha;
+  picosha2::hash256_hex_string(data.begin(), data.end(), sha);
+  return sha;
+}
+
+} // namespace nshash
@@ -0,0 +1,195 @@
+#include "nsjobserver.h"
+
+#include "nslog.h"
+
+#include <charconv>
+#include <cstdlib>
+#include <string_view>
+
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__))
+#define NS_JOBSERVER_POSIX
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef NS_JOBSERVER_POSIX
+/// @brief The value of the last --jobserver-auth (or the older --jobserver-fds) in MAKEFLAGS
+std::string_view jobserver_auth(std::string_view flags)
+{
+  std::string_view auth;
+  for (std::string_view key : {"--jobserver-fds=", "--jobserver-auth="})
+  {
+    auto pos = flags.rfind(key);
+    if (pos == flags.npos)
+      continue;
+    auto value = flags.substr(pos + key.size());
+    auth       = value.substr(0, value.find(' '));
+  }
+  return auth;
+}
+
+bool is_open(int fd) { return fd >= 0 && ::fcntl(fd, F_GETFD) != -1; }
+#endif
+} // namespace
+
+nsjobserver::slot::~slot()
+{
+  if (owner)
+    owner->release(token);
+}
+
+nsjobserver::nsjobserver(std::filesystem::path const& dir, unsigned jobs)
+{
+#ifdef NS_JOBSERVER_POSIX
+  if (auto flags = std::getenv("MAKEFLAGS"))
+  {
+    auto auth = jobserver_auth(flags);
+    if (auth.starts_with("fifo:"))
+    {
+      auto path = std::string{auth.substr(5)};
+      read_fd   = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+      write_fd  = read_fd;
+    }
+    else if (auto comma = auth.find(','); comma != auth.npos)
+    {
+      int r = -1, w = -1;
+      std::from_chars(auth.data(), auth.data() + comma, r);
+      std::from_chars(auth.data() + comma + 1, auth.data() + auth.size(), w);
+      // make only passes its pipe to commands it knows to be recursive
+      if (is_open(r) && is_open(w))
+      {
+        read_fd  = r;
+        write_fd = w;
+      }
+    }
+    if (is_active())
+    {
+      nslog::print("Fetch builds take their jobs from the outer jobserver");
+      return;
+    }
+    if (!auth.empty())
+      nslog::warn("MAKEFLAGS names a jobserver that is not reachable, serving one for the fetch builds");
+  }
+
+  if (jobs < 2)
+    return;
+  fifo = dir / fmt::format("jobserver.{}", ::getpid());
+  ::unlink(fifo.c_str());
+  if (::mkfifo(fifo.c_str(), 0600) != 0)
+    return;
+  owned   = true;
+  read_fd = ::open(fifo.c_str(), O_RDWR | O_CLOEXEC);
+  if (read_fd < 0)
+    return;
+  write_fd = read_fd;
+  // This process holds the first job
+  std::string tokens(jobs - 1, '+');
+  if (::write(write_fd, tokens.data(), tokens.size()) != static_cast<ssize_t>(tokens.size()))
+  {
+    ::close(read_fd);
+    read_fd = write_fd = -1;
+    return;
+  }
+
+  auto flags = fmt::format("-j{} --jobserver-auth=fifo:{}", jobs, fifo.string());
+  if (auto outer = std::getenv("MAKEFLAGS"); outer && *outer)
+    flags = fmt::format("{} {}", outer, flags);
+  env.emplace_back("MAKEFLAGS", std::move(flags));
+  nslog::print(fmt::format("Fetch builds share {} jobs", jobs));
+#endif
+}
+
+nsjobserver::~nsjobserver()
+{
+#ifdef NS_JOBSERVER_POSIX
+  if (owned)
+  {
+    if (read_fd >= 0)
+      ::close(read_fd);
+    ::unlink(fifo.c_str());
+  }
+  else if (read_fd >= 0 && read_fd == write_fd)
+    ::close(read_fd);
+#endif
+}
+
+nsjobserver::slot nsjobserver::acquire()
+{
+  if (!is_active())
+    return {};
+  {
+    std::scoped_lock guard{lock};
+    if (own_job_free)
+    {
+      own_job_free = false;
+      return {this, -1};
+    }
+    ++waiting;
+  }
+#ifdef NS_JOBSERVER_POSIX
+  auto done = [this]()
+  {
+    std::scoped_lock guard{lock};
+    --waiting;
+  };
+  while (true)
+  {
+    unsigned char token = 0;
+    auto          n     = ::read(read_fd, &token, 1);
+    if (n == 1)
+    {
+      done();
+      return {this, token};
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    // make may hand its pipe over non-blocking
+    if (n < 0 && errno == EAGAIN)
+    {
+      pollfd p{read_fd, POLLIN, 0};
+      ::poll(&p, 1, -1);
+      continue;
+    }
+    // The jobserver went away, carry on without a token
+    done();
+    return {};
+  }
+#else
+  return {};
+#endif
+}
+
+void nsjobserver::release(int token)
+{
+  {
+    std::scoped_lock guard{lock};
+    if (token < 0 && waiting == 0)
+    {
+      own_job_free = true;
+      return;
+    }
+    // Threads blocked on the pipe would not see the job of this process come free, it is lent to them as a token
+    // and taken back when a job is given back while nobody waits
+    if (token < 0)
+    {
+      ++lent;
+      token = '+';
+    }
+    else if (lent && waiting == 0)
+    {
+      --lent;
+      own_job_free = true;
+      return;
+    }
+  }
+#ifdef NS_JOBSERVER_POSIX
+  auto c = static_cast<unsigned char>(token);
+  while (::write(write_fd, &c, 1) < 0 && errno == EINTR)
+    ;
+#endif
+}
@@ -0,0 +1,183 @@
+#include "nsjournal.h"
+
+#include "nslog.h"
+#include "nsstatedb.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__))
+#define NS_JOURNAL_POSIX
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+constexpr std::string_view k_session_key = "watch/session";
+constexpr std::string_view k_offset_key  = "watch/offset";
+
+// The watcher wakes up on the event, this only runs out when it is stuck or not following the dir
+constexpr auto k_sync_timeout = std::chrono::seconds(2);
+
+/// @brief The watcher holds an exclusive lock on the journal for as long as it runs
+bool has_watcher(std::filesystem::path const& file)
+{
+#ifdef NS_JOURNAL_POSIX
+  int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  bool locked = ::flock(fd, LOCK_SH | LOCK_NB) != 0;
+  ::close(fd);
+  return locked;
+#else
+  return false;
+#endif
+}
+
+/// @brief Creates a cookie file in watched and waits until the watcher has appended its path to the journal. inotify
+/// reports events in order, so everything changed before the cookie was created is in the journal by then.
+bool sync_with_watcher(std::filesystem::path const& file, std::filesystem::path const& watched)
+{
+#ifdef NS_JOURNAL_POSIX
+  static std::atomic_uint counter = 0;
+  auto cookie = watched / fmt::format("{}{}-{}", nsjournal::k_cookie, ::getpid(), counter++);
+  auto line   = fmt::format("\n{}\n", cookie.generic_string());
+
+  std::error_code ec;
+  auto            from = std::filesystem::file_size(file, ec);
+  if (ec)
+    return false;
+  {
+    std::ofstream off{cookie};
+    if (!off.is_open())
+      return false;
+  }
+
+  // Starts on the newline that ends the last complete line
+  std::string tail;
+  auto        pos      = from ? from - 1 : 0;
+  auto        deadline = std::chrono::steady_clock::now() + k_sync_timeout;
+  bool        seen     = false;
+  while (!seen && std::chrono::steady_clock::now() < deadline)
+  {
+    std::ifstream iff{file, std::ios::binary};
+    iff.seekg(static_cast<std::streamoff>(pos));
+    std::ostringstream ss;
+    ss << iff.rdbuf();
+    auto chunk = ss.str();
+    pos += chunk.size();
+    tail += chunk;
+    seen = tail.find(line) != std::string::npos;
+    if (!seen)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::filesystem::remove(cookie, ec);
+  return seen;
+#else
+  return false;
+#endif
+}
+
+bool is_cookie(std::string_view path)
+{
+  auto name = path.substr(path.rfind('/') + 1);
+  return name.starts_with(nsjournal::k_cookie);
+}
+} // namespace
+
+void nsjournal::load(std::filesystem::path const& file, nsstatedb const& db, std::filesystem::path const& watched)
+{
+  paths.clear();
+  session.clear();
+  end   = 0;
+  valid = false;
+
+  if (!has_watcher(file))
+    return;
+  if (!sync_with_watcher(file, watched))
+  {
+    nslog::warn("The watcher did not catch up in time, falling back to a full scan");
+    return;
+  }
+
+  std::string data;
+  {
+    std::ifstream iff{file, std::ios::binary};
+    if (!iff.is_open())
+      return;
+    std::ostringstream ss;
+    ss << iff.rdbuf();
+    data = ss.str();
+  }
+
+  // Only complete lines, the watcher may be in the middle of appending
+  auto last = data.rfind('\n');
+  if (!data.starts_with(k_header) || last == std::string::npos)
+    return;
+  auto header_end = data.find('\n');
+  session         = data.substr(k_header.size(), header_end - k_header.size());
+  end             = last + 1;
+
+  std::string last_session;
+  std::string last_offset;
+  if (!db.get(k_session_key, last_session) || last_session != session || !db.get(k_offset_key, last_offset))
+    return;
+  std::uint64_t offset = 0;
+  try
+  {
+    offset = std::stoull(last_offset);
+  }
+  catch (std::exception&)
+  {
+    return;
+  }
+  if (offset <= header_end || offset > end)
+    return;
+
+  valid = true;
+  for (auto pos = offset; pos < end;)
+  {
+    auto eol  = data.find('\n', pos);
+    auto line = std::string_view(data).substr(pos, eol - pos);
+    pos       = eol + 1;
+    if (line == k_overflow)
+      valid = false;
+    else if (!line.empty() && !is_cookie(line))
+      paths.emplace_back(line);
+  }
+  std::ranges::sort(paths);
+  paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+}
+
+void nsjournal::commit(nsstatedb& db) const
+{
+  if (session.empty())
+    return;
+  db.put(k_session_key, session);
+  db.put(k_offset_key, std::to_string(end));
+}
+
+bool nsjournal::touched(std::filesystem::path const& dir) const
+{
+  auto key = dir.generic_string();
+  if (std::ranges::binary_search(paths, key))
+    return true;
+  // Anything below dir
+  auto prefix = key + "/";
+  auto it     = std::ranges::lower_bound(paths, prefix);
+  if (it != paths.end() && it->starts_with(prefix))
+    return true;
+  // A parent that was created, moved or deleted
+  for (auto p = dir.parent_path(); p.has_relative_path(); p = p.parent_path())
+  {
+    if (std::ranges::binary_search(paths, p.generic_string()))
+      return true;
+  }
+  return false;
+}
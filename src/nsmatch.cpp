@@ -0,0 +1,613 @@
+#include "nsmatch.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+constexpr int k_end = 256;
+// Beyond this the pattern is left to std::regex
+constexpr std::size_t k_max_nfa_states = 4096;
+constexpr std::size_t k_max_dfa_states = 4096;
+
+using charset = std::bitset<257>;
+
+/// @brief Thrown for syntax the DFA does not cover
+struct unsupported
+{
+};
+
+struct node
+{
+  enum kind_t
+  {
+    set,
+    begin,
+    concat,
+    alt,
+    repeat
+  };
+
+  kind_t            kind     = concat;
+  charset           chars    = {};
+  std::vector<node> children = {};
+  int               min      = 0;
+  int               max      = -1;
+};
+
+class parser
+{
+public:
+  parser(std::string_view p, bool icase) : p(p), icase(icase) {}
+
+  node parse()
+  {
+    auto n = parse_alt();
+    if (pos != p.size())
+      throw unsupported{};
+    return n;
+  }
+
+private:
+  bool more() const { return pos < p.size(); }
+  char peek() const { return p[pos]; }
+
+  node parse_alt()
+  {
+    node n{node::alt};
+    n.children.push_back(parse_concat());
+    while (more() && peek() == '|')
+    {
+      ++pos;
+      n.children.push_back(parse_concat());
+    }
+    return n.children.size() == 1 ? std::move(n.children.front()) : std::move(n);
+  }
+
+  node parse_concat()
+  {
+    node n{node::concat};
+    while (more() && peek() != '|' && peek() != ')')
+      n.children.push_back(parse_repeat());
+    return n;
+  }
+
+  node parse_repeat()
+  {
+    auto n = parse_atom();
+    while (more())
+    {
+      int min = 0, max = -1;
+      if (peek() == '*')
+        ++pos;
+      else if (peek() == '+')
+        ++pos, min = 1;
+      else if (peek() == '?')
+        ++pos, max = 1;
+      else if (peek() == '{')
+        parse_bounds(min, max);
+      else
+        break;
+      // Lazy and greedy match the same names, only the submatch differs
+      if (more() && peek() == '?')
+        ++pos;
+      if (n.kind == node::begin)
+        throw unsupported{};
+      n = node{node::repeat, {}, {std::move(n)}, min, max};
+    }
+    return n;
+  }
+
+  void parse_bounds(int& min, int& max)
+  {
+    ++pos;
+    min = number();
+    max = min;
+    if (more() && peek() == ',')
+    {
+      ++pos;
+      max = more() && std::isdigit(static_cast<unsigned char>(peek())) ? number() : -1;
+    }
+    if (!more() || peek() != '}' || (max >= 0 && max < min) || std::max(min, max) > 64)
+      throw unsupported{};
+    ++pos;
+  }
+
+  int number()
+  {
+    if (!more() || !std::isdigit(static_cast<unsigned char>(peek())))
+      throw unsupported{};
+    int v = 0;
+    while (more() && std::isdigit(static_cast<unsigned char>(peek())) && v < 1000)
+      v = v * 10 + (p[pos++] - '0');
+    return v;
+  }
+
+  node parse_atom()
+  {
+    char c = p[pos++];
+    switch (c)
+    {
+    case '(':
+    {
+      if (more() && peek() == '?')
+      {
+        if (pos + 1 >= p.size() || p[pos + 1] != ':')
+          throw unsupported{};
+        pos += 2;
+      }
+      auto n = parse_alt();
+      if (!more() || peek() != ')')
+        throw unsupported{};
+      ++pos;
+      return n;
+    }
+    case '[':
+      return make_set(parse_class());
+    case '.':
+    {
+      charset s;
+      for (int b = 0; b < 256; ++b)
+        s.set(b, b != '\n' && b != '\r');
+      return make_set(s);
+    }
+    case '^':
+      return node{node::begin};
+    case '$':
+    {
+      charset s;
+      s.set(k_end);
+      return node{node::set, s};
+    }
+    case '\\':
+      return make_set(parse_escape(false));
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+    case '}':
+    case ']':
+    case ')':
+      throw unsupported{};
+    default:
+    {
+      charset s;
+      s.set(static_cast<unsigned char>(c));
+      return make_set(s);
+    }
+    }
+  }
+
+  charset parse_escape(bool in_class)
+  {
+    if (!more())
+      throw unsupported{};
+    char    c = p[pos++];
+    charset s;
+    auto    add_if = [&s](auto&& pred, bool negate)
+    {
+      for (int b = 0; b < 256; ++b)
+        if (pred(b) != negate)
+          s.set(b);
+    };
+    auto word  = [](int b) { return std::isalnum(b) || b == '_'; };
+    auto digit = [](int b) { return b >= '0' && b <= '9'; };
+    auto space = [](int b) { return b == ' ' || (b >= '\t' && b <= '\r'); };
+    switch (c)
+    {
+    case 'd':
+    case 'D':
+      add_if(digit, c == 'D');
+      return s;
+    case 'w':
+    case 'W':
+      add_if(word, c == 'W');
+      return s;
+    case 's':
+    case 'S':
+      add_if(space, c == 'S');
+      return s;
+    case 'n':
+      s.set('\n');
+      return s;
+    case 'r':
+      s.set('\r');
+      return s;
+    case 't':
+      s.set('\t');
+      return s;
+    case 'f':
+      s.set('\f');
+      return s;
+    case 'v':
+      s.set('\v');
+      return s;
+    default:
+      // \b, backreferences, \x and \u escapes and unknown letters
+      if (std::isalnum(static_cast<unsigned char>(c)) && !(in_class && c == 'b'))
+        throw unsupported{};
+      s.set(c == 'b' ? '\b' : static_cast<unsigned char>(c));
+      return s;
+    }
+  }
+
+  charset parse_class()
+  {
+    charset s;
+    bool    negate = more() && peek() == '^';
+    if (negate)
+      ++pos;
+    while (more() && peek() != ']')
+    {
+      int  lo = -1;
+      auto c  = p[pos++];
+      if (c == '\\')
+      {
+        auto e = parse_escape(true);
+        if (e.count() != 1)
+        {
+          s |= e;
+          continue;
+        }
+        for (lo = 0; !e.test(lo); ++lo)
+          ;
+      }
+      else if (c == '[')
+        throw unsupported{};
+      else
+        lo = static_cast<unsigned char>(c);
+
+      if (pos + 1 < p.size() && peek() == '-' && p[pos + 1] != ']')
+      {
+        ++pos;
+        int hi = static_cast<unsigned char>(p[pos++]);
+        if (hi == '\\')
+        {
+          auto e = parse_escape(true);
+          if (e.count() != 1)
+            throw unsupported{};
+          for (hi = 0; !e.test(hi); ++hi)
+            ;
+        }
+        if (hi < lo)
+          throw unsupported{};
+        for (int b = lo; b <= hi; ++b)
+          s.set(b);
+      }
+      else
+        s.set(lo);
+    }
+    if (!more())
+      throw unsupported{};
+    ++pos;
+    if (negate)
+    {
+      // Case is folded first, [^a] rejects 'A' too
+      s = make_set(s).chars;
+      s.flip();
+      s.reset(k_end);
+    }
+    return s;
+  }
+
+  node make_set(charset s) const
+  {
+    if (icase)
+    {
+      for (int b = 'a'; b <= 'z'; ++b)
+      {
+        if (s.test(b) || s.test(b - 'a' + 'A'))
+        {
+          s.set(b);
+          s.set(b - 'a' + 'A');
+        }
+      }
+    }
+    return node{node::set, s};
+  }
+
+  std::string_view p;
+  std::size_t      pos = 0;
+  bool             icase;
+};
+
+/// @brief Thompson automaton, every state either consumes a symbol or has up to two epsilon edges
+struct nfa
+{
+  struct state
+  {
+    charset on;
+    int     out   = -1;
+    int     eps[2] = {-1, -1};
+    // eps[0] is only taken at the start of input
+    bool    begin  = false;
+    bool    accept = false;
+  };
+
+  struct fragment
+  {
+    int start = -1;
+    int end   = -1;
+  };
+
+  std::vector<state> states;
+
+  int add()
+  {
+    if (states.size() >= k_max_nfa_states)
+      throw unsupported{};
+    states.emplace_back();
+    return static_cast<int>(states.size() - 1);
+  }
+
+  void link(int from, int to)
+  {
+    auto& s = states[from];
+    (s.eps[0] < 0 ? s.eps[0] : s.eps[1]) = to;
+  }
+
+  fragment build(node const& n)
+  {
+    fragment f{add(), -1};
+    switch (n.kind)
+    {
+    case node::set:
+      f.end                  = add();
+      states[f.start].on     = n.chars;
+      states[f.start].out    = f.end;
+      break;
+    case node::begin:
+      f.end                  = add();
+      states[f.start].begin  = true;
+      states[f.start].eps[0] = f.end;
+      break;
+    case node::concat:
+      f.end = f.start;
+      for (auto const& c : n.children)
+      {
+        auto next = build(c);
+        link(f.end, next.start);
+        f.end = next.end;
+      }
+      break;
+    case node::alt:
+    {
+      // Two epsilon edges per state, alternatives branch off a chain
+      f.end   = add();
+      int fan = f.start;
+      for (std::size_t i = 0; i < n.children.size(); ++i)
+      {
+        auto c = build(n.children[i]);
+        link(c.end, f.end);
+        if (i + 1 == n.children.size())
+          link(fan, c.start);
+        else
+        {
+          auto rest = i + 2 == n.children.size() ? -1 : add();
+          link(fan, c.start);
+          if (rest >= 0)
+          {
+            link(fan, rest);
+            fan = rest;
+          }
+        }
+      }
+      break;
+    }
+    case node::repeat:
+    {
+      f.end = f.start;
+      for (int i = 0; i < n.min; ++i)
+      {
+        auto c = build(n.children.front());
+        link(f.end, c.start);
+        f.end = c.end;
+      }
+      if (n.max < 0)
+      {
+        auto c    = build(n.children.front());
+        auto exit = add();
+        auto loop = add();
+        link(f.end, loop);
+        link(loop, c.start);
+        link(loop, exit);
+        link(c.end, loop);
+        f.end = exit;
+      }
+      else
+      {
+        auto exit = add();
+        for (int i = n.min; i < n.max; ++i)
+        {
+          auto c    = build(n.children.front());
+          auto skip = add();
+          link(f.end, skip);
+          link(skip, c.start);
+          link(skip, exit);
+          f.end = c.end;
+        }
+        link(f.end, exit);
+        f.end = exit;
+      }
+      break;
+    }
+    }
+    return f;
+  }
+};
+
+/// @brief Subset construction, every reachable set of consuming and accepting states becomes a DFA state
+class subset_builder
+{
+public:
+  using key = std::vector<int>;
+
+  subset_builder(nfa const& n, int start) : n(n), start(start) {}
+
+  template <typename Automaton>
+  void build(Automaton& a)
+  {
+    a.next.clear();
+    a.accept.clear();
+    ids.clear();
+    // The dead state
+    intern({}, a);
+    a.start_at_begin = intern(closure({start}, true), a);
+    a.start          = intern(closure({start}, false), a);
+    for (std::size_t d = 1; d < pending.size(); ++d)
+    {
+      auto current = pending[d];
+      for (int sym = 0; sym <= k_end; ++sym)
+      {
+        key moved;
+        for (auto s : current)
+          if (n.states[s].on.test(sym))
+            moved.push_back(n.states[s].out);
+        a.next[d][sym] = moved.empty() ? 0 : intern(closure(moved, false), a);
+      }
+    }
+    pending.clear();
+  }
+
+private:
+  key closure(key seeds, bool at_begin) const
+  {
+    std::vector<bool> seen(n.states.size());
+    key               out;
+    while (!seeds.empty())
+    {
+      auto s = seeds.back();
+      seeds.pop_back();
+      if (s < 0 || seen[s])
+        continue;
+      seen[s]   = true;
+      auto& st  = n.states[s];
+      if (st.on.any() || st.accept)
+        out.push_back(s);
+      if (st.begin && !at_begin)
+        continue;
+      seeds.push_back(st.eps[0]);
+      seeds.push_back(st.eps[1]);
+    }
+    std::ranges::sort(out);
+    return out;
+  }
+
+  template <typename Automaton>
+  std::uint32_t intern(key k, Automaton& a)
+  {
+    auto it = ids.find(k);
+    if (it != ids.end())
+      return it->second;
+    if (a.next.size() >= k_max_dfa_states)
+      throw unsupported{};
+    auto id = static_cast<std::uint32_t>(a.next.size());
+    a.next.emplace_back().fill(0);
+    a.accept.push_back(std::ranges::any_of(k, [this](int s) { return n.states[s].accept; }));
+    ids.emplace(k, id);
+    pending.resize(id + 1);
+    pending[id] = std::move(k);
+    return id;
+  }
+
+  nfa const&                       n;
+  int                              start;
+  std::map<key, std::uint32_t>     ids;
+  std::vector<key>                 pending;
+};
+} // namespace
+
+struct nsmatcher::lazy_regex
+{
+  std::string           pattern;
+  std::regex::flag_type flags;
+  std::once_flag        once;
+  std::regex            re;
+
+  lazy_regex(std::string p, std::regex::flag_type f) : pattern(std::move(p)), flags(f) {}
+
+  std::regex const& get()
+  {
+    std::call_once(once, [this] { re = std::regex(pattern, flags); });
+    return re;
+  }
+};
+
+nsmatcher::nsmatcher(std::string_view pattern, bool icase)
+{
+  auto flags = icase ? std::regex::ECMAScript | std::regex::icase : std::regex::ECMAScript;
+  try
+  {
+    auto ast = parser(pattern, icase).parse();
+
+    nfa  n;
+    auto f                 = n.build(ast);
+    n.states[f.end].accept = true;
+
+    // Searching is anchored matching behind a loop that restarts the pattern at every byte
+    auto loop = n.add();
+    for (int b = 0; b < 256; ++b)
+      n.states[loop].on.set(b);
+    n.states[loop].out    = loop;
+    n.states[loop].eps[0] = f.start;
+    subset_builder(n, loop).build(searcher);
+    extent = std::make_shared<lazy_regex>(std::string(pattern), flags);
+  }
+  catch (unsupported const&)
+  {
+    searcher = {};
+    fallback = std::make_shared<std::regex>(std::string(pattern), flags);
+  }
+}
+
+bool nsmatcher::search(std::string_view s, std::size_t from) const
+{
+  if (fallback)
+  {
+    std::match_results<std::string_view::const_iterator> m;
+    return std::regex_search(s.begin() + from, s.end(), m, *fallback,
+                             from ? std::regex_constants::match_prev_avail : std::regex_constants::match_default);
+  }
+  if (searcher.next.empty())
+    return false;
+
+  auto state = from ? searcher.start : searcher.start_at_begin;
+  for (auto i = from; i < s.size() && !searcher.accept[state]; ++i)
+    state = searcher.next[state][static_cast<unsigned char>(s[i])];
+  return searcher.accept[state] || searcher.accept[searcher.next[state][k_end]];
+}
+
+bool nsmatcher::find(std::string_view s, std::size_t& start, std::size_t& length, std::size_t from) const
+{
+  // Most names do not match at all, one pass of the DFA tells. Where they do the DFA finds the leftmost longest match
+  // while ECMAScript prefers lazy quantifiers and earlier alternatives, the extent comes from std::regex.
+  if (!fallback && !search(s, from))
+  {
+#ifndef NDEBUG
+    std::match_results<std::string_view::const_iterator> m;
+    if (std::regex_search(s.begin() + from, s.end(), m, extent->get(),
+                          from ? std::regex_constants::match_prev_avail : std::regex_constants::match_default))
+      throw std::logic_error("nsmatcher: the DFA missed a match std::regex finds in " + std::string(s));
+#endif
+    return false;
+  }
+
+  std::match_results<std::string_view::const_iterator> m;
+  if (!std::regex_search(s.begin() + from, s.end(), m, fallback ? *fallback : extent->get(),
+                         from ? std::regex_constants::match_prev_avail : std::regex_constants::match_default))
+  {
+#ifndef NDEBUG
+    if (!fallback)
+      throw std::logic_error("nsmatcher: the DFA matches what std::regex does not in " + std::string(s));
+#endif
+    return false;
+  }
+  start  = static_cast<std::size_t>(m[0].first - s.begin());
+  length = static_cast<std::size_t>(m[0].length());
+  return true;
+}
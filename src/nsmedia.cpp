@@ -0,0 +1,88 @@
+#include "nsmedia.h"
+
+#include "nsmmap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+constexpr char k_magic[] = "nsmedia2";
+
+template <typename T>
+void put(std::string& out, T v)
+{
+  out.append(reinterpret_cast<char const*>(&v), sizeof(v));
+}
+
+template <typename T>
+bool get(std::string_view& in, T& v)
+{
+  if (in.size() < sizeof(v))
+    return false;
+  std::memcpy(&v, in.data(), sizeof(v));
+  in.remove_prefix(sizeof(v));
+  return true;
+}
+} // namespace
+
+bool nsmedia_manifest::read(std::filesystem::path const& path)
+{
+  entries.clear();
+  target = 0;
+  nsmapped_file file;
+  if (!file.open(path))
+    return false;
+  auto in = file.view();
+  if (!in.starts_with(std::string_view{k_magic, sizeof(k_magic) - 1}))
+    return false;
+  in.remove_prefix(sizeof(k_magic) - 1);
+
+  std::uint64_t count = 0;
+  if (!get(in, target) || !get(in, count))
+    return false;
+  entries.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(count, in.size())));
+  for (std::uint64_t i = 0; i < count; ++i)
+  {
+    entry         e;
+    std::uint32_t length = 0;
+    if (!get(in, e.size) || !get(in, e.mtime_ns) || !get(in, e.hash) || !get(in, length) || in.size() < length)
+    {
+      entries.clear();
+      return false;
+    }
+    e.path.assign(in.data(), length);
+    in.remove_prefix(length);
+    entries.emplace_back(std::move(e));
+  }
+  return true;
+}
+
+bool nsmedia_manifest::write(std::filesystem::path const& path)
+{
+  std::ranges::sort(entries, {}, &entry::path);
+
+  std::string out = k_magic;
+  put(out, target);
+  put(out, static_cast<std::uint64_t>(entries.size()));
+  for (auto const& e : entries)
+  {
+    put(out, e.size);
+    put(out, e.mtime_ns);
+    put(out, e.hash);
+    put(out, static_cast<std::uint32_t>(e.path.size()));
+    out += e.path;
+  }
+
+  // Left alone when unchanged, the data group step is not run again for it
+  {
+    nsmapped_file existing;
+    if (existing.open(path) && existing.view() == out)
+      return true;
+  }
+  std::ofstream ofs{path, std::ios::binary};
+  ofs.write(out.data(), static_cast<std::streamsize>(out.size()));
+  ofs.close();
+  return !ofs.fail();
+}
@@ -0,0 +1,166 @@
+#include "nsmmap.h"
+
+#include "nsprofile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <utility>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#define NS_WIN32_MMAP
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool nsmapped_file::open(std::filesystem::path const& path)
+{
+  close();
+#ifdef NS_WIN32_MMAP
+  HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (h == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER fsize;
+  if (!GetFileSizeEx(h, &fsize))
+  {
+    CloseHandle(h);
+    return false;
+  }
+  file   = h;
+  opened = true;
+  if (fsize.QuadPart == 0)
+  {
+    nsprofile::touch();
+    return true;
+  }
+  mapping = CreateFileMappingW(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping)
+  {
+    close();
+    return false;
+  }
+  data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!data)
+  {
+    close();
+    return false;
+  }
+  size = static_cast<std::size_t>(fsize.QuadPart);
+  nsprofile::touch(size);
+  return true;
+#else
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat sb;
+  if (::fstat(fd, &sb) != 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  opened = true;
+  if (sb.st_size > 0)
+  {
+    auto p = ::mmap(nullptr, static_cast<std::size_t>(sb.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+      opened = false;
+    else
+    {
+      data = p;
+      size = static_cast<std::size_t>(sb.st_size);
+    }
+  }
+  // The mapping keeps the file alive
+  ::close(fd);
+  if (opened)
+    nsprofile::touch(size);
+  return opened;
+#endif
+}
+
+void nsmapped_file::close()
+{
+#ifdef NS_WIN32_MMAP
+  if (data)
+    UnmapViewOfFile(data);
+  if (mapping)
+    CloseHandle(mapping);
+  if (file)
+    CloseHandle(file);
+  mapping = nullptr;
+  file    = nullptr;
+#else
+  if (data)
+    ::munmap(const_cast<void*>(data), size);
+#endif
+  data   = nullptr;
+  size   = 0;
+  opened = false;
+}
+
+void nsmapped_file::swap(nsmapped_file& other) noexcept
+{
+  std::swap(data, other.data);
+  std::swap(size, other.size);
+  std::swap(opened, other.opened);
+#ifdef NS_WIN32_MMAP
+  std::swap(file, other.file);
+  std::swap(mapping, other.mapping);
+#endif
+}
+
+char* nsfile_arena::reserve(std::size_t size)
+{
+  std::scoped_lock guard{lock};
+  if (chunks.empty() || chunks.back().capacity - chunks.back().used < size)
+  {
+    auto make = [](std::size_t capacity)
+    { return chunk{std::make_unique_for_overwrite<char[]>(capacity), capacity, 0}; };
+    // Large files get a chunk of their own, the last chunk keeps taking the small ones
+    if (size > k_chunk / 4 && !chunks.empty())
+    {
+      auto& own = *chunks.insert(chunks.end() - 1, make(size));
+      own.used  = size;
+      return own.data.get();
+    }
+    chunks.push_back(make(std::max(size, k_chunk)));
+  }
+  auto& last = chunks.back();
+  auto* at   = last.data.get() + last.used;
+  last.used += size;
+  return at;
+}
+
+bool nsfile_arena::read(std::filesystem::path const& path, std::string_view& text)
+{
+  std::ifstream in{path, std::ios::binary | std::ios::ate};
+  if (!in)
+    return false;
+  auto end = in.tellg();
+  if (end < 0)
+    return false;
+  auto size = static_cast<std::size_t>(end);
+  in.seekg(0);
+
+  // Reserved under the lock, read without it
+  auto* dest = reserve(size + 1);
+  // The file may have shrunk since it was measured
+  auto read  = static_cast<std::size_t>(in.rdbuf()->sgetn(dest, static_cast<std::streamsize>(size)));
+  dest[read] = 0;
+  text       = {dest, read};
+  nsprofile::touch(read);
+  return true;
+}
+
+void nsfile_arena::pop(std::string_view text)
+{
+  std::scoped_lock guard{lock};
+  if (!chunks.empty() && text.data() + text.size() + 1 == chunks.back().data.get() + chunks.back().used)
+    chunks.back().used -= text.size() + 1;
+}
@@ -1,17 +1,24 @@
 #include "nsmodule.h"
 
+#include "nsbincache.h"
 #include "nsbuild.h"
 #include "nscmake.h"
 #include "nscmake_conststr.h"
 #include "nsenums.h"
+#include "nshash.h"
 #include "nslog.h"
+#include "nsmedia.h"
+#include "nsparallel.h"
+#include "nsprofile.h"
 #include "nspreset.h"
 #include "nsprocess.h"
+#include "nsstatcache.h"
 #include "nstarget.h"
-#include "picosha2.h"
 
+#include <charconv>
 #include <fstream>
 #include <sstream>
+#include <unordered_set>
 
 bool has_data(nsmodule_type t)
 {
@@ -70,6 +77,7 @@ nsfetch* nsmodule::find_fetch(std::string_view name)
 
 void nsmodule::process(nsbuild const& bc, nsinstallers& installer, std::string const& targ_name, nstarget& targ)
 {
+  nsprofile::span span{"process_target", targ_name};
   update_properties(bc, targ_name, targ);
   if (disabled)
   {
@@ -79,40 +87,50 @@ void nsmodule::process(nsbuild const& bc, nsinstallers& installer, std::string c
 
   update_macros(bc, targ_name, targ);
   update_fetch(bc, installer);
-  write_sha(bc);
+  // Written once the fetches are built, a failed build is retried on the next check
+  if (fetch_builds.empty())
+    write_sha(bc);
 }
 
 void nsmodule::check_embeds(nsbuild const& bc) const
 {
+  nsprofile::span span{"check_embeds", target_name};
+
   auto hpp = get_full_gen_dir(bc) / "local" / fmt::format("{}Resources.hpp", name);
   auto cpp = get_full_gen_dir(bc) / "local" / fmt::format("{}Resources.cpp", name);
 
-  bool        rewrite_resources = false;
-  std::string cpp_content;
-  std::string csha;
-  picosha2::hash256_hex_string(embedded_binary_files.cpp, csha);
+  // Embedded files are only read when one of them or the embed list has changed
+  std::string manifest;
+  for (auto const& f : embedded_binary_files.files)
+    manifest += fmt::format("{}={}:{}\n", f.name, f.value, bc.stat_cache->digest(f.file));
+  auto csha = nshash::fast_hex(manifest);
   if (!std::filesystem::exists(hpp) || !std::filesystem::exists(cpp) || sha_changed(bc, "embed", csha))
   {
+    ns_embed_content::generated gen;
+    embedded_binary_files.generate(gen);
 
     std::ofstream(hpp, std::ios::binary) << "#pragma once\n#include <string_view>\nnamespace " << bc.namespace_name
                                          << "::embed \n{\n"
-                                         << embedded_binary_files.hpp << "\n}";
+                                         << gen.hpp << "\n}";
 
     std::ofstream(cpp, std::ios::binary) << "#include \"" << name << "Resources.hpp\"\nnamespace " << bc.namespace_name
                                          << "::embed \n{\n"
-                                         << embedded_binary_files.cpp << "\n}";
+                                         << gen.cpp << "\n}";
     write_sha_changed(bc, "embed", csha);
   }
 }
 
 void nsmodule::check_enums(nsbuild const& bc) const
 {
+  nsprofile::span span{"check_enums", target_name};
+
   auto lenums = std::filesystem::path(source_path) / "private" / "Enums.json";
   auto enums  = std::filesystem::path(source_path) / "public" / "Enums.json";
 
-  std::string content;
-  size_t      lenums_size = std::filesystem::exists(lenums) ? std::filesystem::file_size(lenums) : 0;
-  size_t      enums_size  = std::filesystem::exists(enums) ? std::filesystem::file_size(enums) : 0;
+  nsstatcache::stamp lstamp;
+  nsstatcache::stamp stamp;
+  size_t             lenums_size = nsstatcache::get_stamp(lenums, lstamp) ? lstamp.size : 0;
+  size_t             enums_size  = nsstatcache::get_stamp(enums, stamp) ? stamp.size : 0;
 
   if (!lenums_size && !enums_size)
   {
@@ -121,26 +139,31 @@ void nsmodule::check_enums(nsbuild const& bc) const
     {
       write_sha_changed(bc, "enums", "");
     }
-  }
-  content.resize(lenums_size + enums_size, ' ');
-  if (std::filesystem::exists(lenums))
-  {
-    std::ifstream iff{lenums};
-    if (iff.is_open())
-      iff.read(content.data(), lenums_size);
-  }
-
-  if (std::filesystem::exists(enums))
-  {
-    std::ifstream iff{enums};
-    if (iff.is_open())
-      iff.read(content.data() + lenums_size, enums_size);
+    return;
   }
 
-  std::string sha;
-  picosha2::hash256_hex_string(content, sha);
+  // Hash the stat manifest digests, the json is only read when it has to be regenerated
+  auto sha = nshash::fast_hex(fmt::format("{}\n{}\n", bc.stat_cache->digest(lenums), bc.stat_cache->digest(enums)));
   if (sha_changed(bc, "enums", sha) || nsenum_context::outputs_missing(*this, bc, lenums_size > 0, enums_size > 0))
   {
+    std::string content;
+    content.resize(lenums_size + enums_size, ' ');
+    if (lenums_size)
+    {
+      std::ifstream iff{lenums};
+      if (iff.is_open())
+        iff.read(content.data(), lenums_size);
+      nsprofile::touch(lenums_size);
+    }
+
+    if (enums_size)
+    {
+      std::ifstream iff{enums};
+      if (iff.is_open())
+        iff.read(content.data() + lenums_size, enums_size);
+      nsprofile::touch(enums_size);
+    }
+
     nsenum_context::clean(*this, bc);
     write_sha_changed(bc, "enums", sha);
 
@@ -172,9 +195,9 @@ void nsmodule::update_properties(nsbuild const& bc, std::string const& targ_name
     glob_media.add_set(p / bc.media_name);
     glob_media.recurse              = true;
     glob_media.path_exclude_filters = bc.media_exclude_filter;
-    glob_media.accumulate();
-    if ((has_globs_changed |= sha_changed(bc, "data_group", glob_media.sha)))
-      write_sha_changed(bc, "data_group", glob_media.sha);
+    // --copy-media needs the manifest, walk the media of a module the journal skipped if it has none yet
+    if (unchanged && !std::filesystem::exists(get_full_gen_dir(bc) / "media.manifest"))
+      unchanged = false;
   }
 
   if (has_data(type))
@@ -186,13 +209,14 @@ void nsmodule::update_properties(nsbuild const& bc, std::string const& targ_name
     step.artifacts.push_back("${data_group_output}");
     step.check = "data_group";
     step.dependencies.push_back("${data_group}");
+    step.dependencies.push_back("${module_gen_dir}/media.manifest");
     step.injected_config_body = "if(data_group)";
     step.injected_config_end  = "endif()";
     unset.emplace_back("data_group");
     cmd.msgs.push_back(fmt::format("Building data files for {}", name));
     cmd.command = "${nsbuild}";
-    cmd.params  = fmt::format("--copy-media ${{module_dir}}/{0} ${{config_rt_dir}}/{0} ${{module_gen_dir}}/media.files "
-                               "${{config_ignored_media}}",
+    cmd.params  = fmt::format("--copy-media ${{module_dir}}/{0} ${{config_rt_dir}}/{0} "
+                               "${{module_gen_dir}}/media.manifest ${{module_gen_dir}}/media.deployed",
                               bc.media_name);
 
     step.steps.push_back(cmd);
@@ -228,15 +252,11 @@ void nsmodule::update_properties(nsbuild const& bc, std::string const& targ_name
     glob_sources.file_filters = &filters;
     gather_sources(glob_sources, bc);
     gather_headers(glob_sources, bc);
-
-    if (!bc.s_current_preset->glob_sources)
-    {
-      glob_sources.accumulate();
-      if ((has_globs_changed |= sha_changed(bc, "src", glob_media.sha)))
-        write_sha_changed(bc, "src", glob_media.sha);
-    }
   }
 
+  // Globs of all modules are walked together once every target is processed
+  globs_deferred = true;
+
   if (intf[nsmodule::priv_intf].empty())
     intf[nsmodule::priv_intf].emplace_back();
 
@@ -342,7 +362,7 @@ void nsmodule::update_macros(nsbuild const& bc, std::string const& targ_name, ns
       macros[fmt::format("{}_package", ft.name)]     = ft.package;
       macros[fmt::format("{}_namespace", ft.name)]   = ft.namespace_name;
       macros[fmt::format("{}_repo", ft.name)]        = ft.repo;
-      macros[fmt::format("{}_commit", ft.name)]      = ft.tag;
+      macros[fmt::format("{}_commit", ft.name)]      = ft.commit.empty() ? ft.tag : ft.commit;
       macros[fmt::format("{}_components", ft.name)]  = components;
       macros[fmt::format("{}_extern_name", ft.name)] = ft.extern_name;
 
@@ -370,7 +390,9 @@ void nsmodule::delete_build(nsbuild const& bc)
   {
     auto fetch_bld = get_fetch_bld_dir(bc, ft);
     nslog::print(fmt::format("Deleting Fetch : {}", ft.name));
-    std::filesystem::remove(get_full_fetch_file(bc, ft), ec);
+    bc.state_db->erase(fmt::format("fetch/{}", ft.name));
+    bc.state_db->erase(fmt::format("fetch_configure/{}", ft.name));
+    bc.state_db->erase(fmt::format("fetch_install/{}", ft.name));
     nsbuild::remove_cache(get_full_dl_dir(bc, ft));
     nsbuild::remove_cache(fetch_bld);
     bc.install_cache.uninstall((fetch_bld / "install_manifest.txt").string());
@@ -382,8 +404,15 @@ void nsmodule::delete_build(nsbuild const& bc)
 
 void nsmodule::update_fetch(nsbuild const& bc, nsinstallers& installer)
 {
-  if (fetch.empty())
-    return;
+  for (auto& ft : fetch)
+  {
+    if (!ft.disabled)
+      fetch_content(bc, installer, ft);
+  }
+}
+
+void nsmodule::update_fetch_state(nsbuild const& bc)
+{
   for (auto& ft : fetch)
   {
     if (ft.repo.empty() || ft.disabled)
@@ -394,12 +423,27 @@ void nsmodule::update_fetch(nsbuild const& bc, nsinstallers& installer)
     else
       ft.regenerate = regenerate;
   }
+}
 
-  for (auto& ft : fetch)
+bool nsmodule::needs_download(nsbuild const& bc, nsfetch const& ft) const
+{
+  return !std::filesystem::exists(get_fetch_src_dir(bc, ft) / "CMakeLists.txt") || ft.regenerate ||
+         ft.force_download;
+}
+
+void nsmodule::prefetch(nsbuild const& bc, nsfetch& ft) const
+{
+  nslog::print(fmt::format("Downloading : {}..", ft.name));
+  try
   {
-    if (!ft.disabled)
-      fetch_content(bc, installer, ft);
+    download_source(bc, ft);
+  }
+  catch (std::exception&)
+  {
+    nslog::error(fmt::format("Download failed : {}", ft.name));
+    throw;
   }
+  ft.downloaded = true;
 }
 
 void nsmodule::write_fetch_build_content(nsbuild const& bc, nsfetch const& ft, content const& cc) const
@@ -466,7 +510,9 @@ nsmodule::content nsmodule::make_fetch_build_content(nsbuild const& bc, nsfetch
   content cc;
   cc.data = ofs.str();
 
-  picosha2::hash256_hex_string(cc.data, cc.sha);
+  // Fetch builds may be pinned by this digest, keep it a SHA-256
+  nsprofile::span span{"hash", ft.name};
+  cc.sha = nshash::sha256_hex(cc.data);
   return cc;
 }
 
@@ -493,12 +539,7 @@ void nsmodule::fetch_content(nsbuild const& bc, nsinstallers& installer, nsfetch
   }
 
   if (change || ft.force_build || force_build)
-  {
-    nslog::print(fmt::format("Rebuilding : {}..", ft.name));
-    build_fetched_content(bc, installer, ft);
-    write_fetch_meta(bc, ft, sha);
-    was_fetch_rebuilt = true;
-  }
+    fetch_builds.push_back({static_cast<std::size_t>(&ft - fetch.data()), sha});
   else
   {
     auto xpb = get_fetch_bld_dir(bc, ft);
@@ -507,30 +548,111 @@ void nsmodule::fetch_content(nsbuild const& bc, nsinstallers& installer, nsfetch
   }
 }
 
-bool nsmodule::fetch_changed(nsbuild const& bc, nsfetch const& ft, std::string const& last_sha) const
+void nsmodule::build_fetches(nsbuild const& bc, nsinstallers& installer)
 {
-  auto          meta = get_full_fetch_file(bc, ft);
-  std::ifstream iff{meta};
-  if (iff.is_open())
+  if (fetch_builds.empty())
+    return;
+  // Fetches of one module are built in their order, a later one may find an earlier one
+  for (auto const& b : fetch_builds)
   {
-    std::string sha;
-    iff >> sha;
-    if (sha == last_sha)
-      return false;
+    auto const& ft = fetch[b.index];
+    nslog::print(fmt::format("Rebuilding : {}..", ft.name));
+    build_fetched_content(bc, installer, ft);
+    write_fetch_meta(bc, ft, b.sha);
   }
-  return true;
+  fetch_builds.clear();
+  was_fetch_rebuilt = true;
+  write_sha(bc);
+}
+
+std::string nsmodule::fetch_build_inputs(nsbuild const& bc, nsfetch const& ft) const
+{
+  // The generated CMakeLists.txt holds the prepare and finalize fragments, macros and compiler options, the presets
+  // hold the compiler paths, generator and build type
+  auto read = [&](char const* name)
+  {
+    nsmapped_file file;
+    return file.open(get_fetch_src_dir(bc, ft) / name) ? std::string{file.view()} : std::string{};
+  };
+  auto const& info = bc.cmakeinfo;
+
+  auto content = fmt::format("{}\n{}\n{}\n{}\n{}\n{}\n", info.cmake_cppcompiler, info.cmake_cppcompiler_version,
+                             info.cmake_ccompiler, info.cmake_generator, info.cmake_config, info.target_platform);
+  std::ostringstream args;
+  for (auto const& a : ft.args)
+    a.print(args, output_fmt::set_cache, false);
+  content += args.str();
+  content += read("CMakeLists.txt");
+  content += read("CMakePresets.json");
+  return content;
+}
+
+std::string nsmodule::fetch_cache_key(nsbuild const& bc, nsfetch const& ft) const
+{
+  auto own = [&bc](nsmodule const& m, nsfetch const& f)
+  {
+    return fmt::format("{}\n{}\n{}\n{}\n{}\n", f.repo, f.tag, f.commit, f.version, f.source) +
+           m.fetch_build_inputs(bc, f);
+  };
+  auto content = "nsbincache 3\n" + own(*this, ft);
+
+  // A fetch builds against what is already in the sdk: the fetches listed before it and every fetch of the modules
+  // this one depends on, directly or not. A dependency that changed must not restore a binary built against the
+  // old one.
+  for (auto const& f : fetch)
+  {
+    if (&f == &ft)
+      break;
+    content += own(*this, f);
+  }
+  std::unordered_set<std::string_view> seen;
+  std::vector<nsmodule const*>         pending = {this};
+  while (!pending.empty())
+  {
+    auto m = pending.back();
+    pending.pop_back();
+    auto visit = [&](std::string_view dep)
+    {
+      auto it = bc.targets.find(std::string{dep});
+      if (it == bc.targets.end() || !seen.emplace(it->first).second)
+        return;
+      auto const& module = bc.frameworks[it->second.fw_idx].modules[it->second.mod_idx];
+      if (&module == this)
+        return;
+      pending.push_back(&module);
+      for (auto const& f : module.fetch)
+        content += own(module, f);
+    };
+    m->foreach_references(visit);
+    m->foreach_dependency(visit);
+  }
+  return nshash::sha256_hex(nsbincache::relocatable(bc, std::move(content)));
+}
+
+std::string nsmodule::fetch_configure_key(nsbuild const& bc, nsfetch const& ft) const
+{
+  auto const& info    = bc.cmakeinfo;
+  auto        content = fmt::format("{}\n{}\n{}\n", info.cmake_bin, info.cmake_preset_name, info.cmake_toolchain);
+  if (!info.cmake_toolchain.empty())
+  {
+    nsmapped_file toolchain;
+    if (toolchain.open(info.cmake_toolchain))
+      content += toolchain.view();
+  }
+  content += fetch_build_inputs(bc, ft);
+  return nshash::fast_hex(content);
+}
+
+bool nsmodule::fetch_changed(nsbuild const& bc, nsfetch const& ft, std::string const& last_sha) const
+{
+  return !bc.state_db->matches(fmt::format("fetch/{}", ft.name), last_sha);
 }
 
 void nsmodule::write_fetch_meta(nsbuild const& bc, nsfetch const& ft, std::string const& last_sha) const
 {
   if (last_sha.empty())
     return;
-  auto          meta = get_full_fetch_file(bc, ft);
-  std::ofstream off{meta};
-  if (off.is_open())
-  {
-    off << last_sha;
-  }
+  bc.state_db->put(fmt::format("fetch/{}", ft.name), last_sha);
 }
 
 void nsmodule::write_main_build(std::ostream& ofs, nsbuild const& bc) const
@@ -1276,20 +1398,112 @@ void nsmodule::write_runtime_settings(std::ostream& ofs, nsbuild const& bc) cons
   }
 }
 
+namespace
+{
+/// @brief Size and time of the ninja log, which only changes when ninja ran a command. Empty for other generators,
+/// their builds are always installed.
+std::string build_stamp(std::filesystem::path const& xpb)
+{
+  std::error_code ec;
+  auto            log  = xpb / ".ninja_log";
+  auto            size = std::filesystem::file_size(log, ec);
+  if (ec)
+    return {};
+  auto time = std::filesystem::last_write_time(log, ec);
+  if (ec)
+    return {};
+  return fmt::format("{}:{}", size, time.time_since_epoch().count());
+}
+
+/// @brief True when every file in the install manifest exists
+bool is_installed(std::filesystem::path const& manifest)
+{
+  std::ifstream files{manifest};
+  if (!files)
+    return false;
+  std::error_code ec;
+  std::string     line;
+  while (std::getline(files, line))
+  {
+    if (!line.empty() && !std::filesystem::exists(std::filesystem::symlink_status(line, ec)))
+      return false;
+  }
+  return true;
+}
+} // namespace
+
 void nsmodule::build_fetched_content(nsbuild const& bc, nsinstallers& installer, nsfetch const& ft)
 {
-  auto src  = get_fetch_src_dir(bc, ft);
-  auto xpb  = get_fetch_bld_dir(bc, ft);
-  auto dsdk = get_full_sdk_dir(bc);
+  auto src      = get_fetch_src_dir(bc, ft);
+  auto xpb      = get_fetch_bld_dir(bc, ft);
+  auto dsdk     = get_full_sdk_dir(bc);
+  auto manifest = xpb / "install_manifest.txt";
+  auto key      = bc.get_full_bincache_dir().empty() ? std::string{} : fetch_cache_key(bc, ft);
+
+  bool restored = false;
+  if (!key.empty())
+  {
+    std::scoped_lock guard{*bc.sdk_lock};
+    restored = nsbincache::restore(bc, key, dsdk, manifest);
+    if (restored)
+      nslog::print(fmt::format("Restored from binary cache : {}", ft.name));
+  }
 
-  nsprocess::cmake_config(bc, {}, cmake::path(src), xpb);
+  bool        configured = false;
+  std::string stamp;
+  if (!restored)
+  {
+    // A build dir configured from the same inputs is only built, the build reruns cmake itself when a listfile of
+    // the package changed
+    auto configure_key = fetch_configure_key(bc, ft);
+    auto configure_id  = fmt::format("fetch_configure/{}", ft.name);
+    if (!std::filesystem::exists(xpb / "CMakeCache.txt") || !bc.state_db->matches(configure_id, configure_key))
+    {
+      nsprofile::span span{"fetch configure", ft.name};
+      bc.state_db->erase(configure_id);
+      nsprocess::cmake_config(bc, {}, cmake::path(src), xpb);
+      bc.state_db->put(configure_id, configure_key);
+      configured = true;
+    }
+    else if (bc.verbose)
+      nslog::print(fmt::format("Already Configured : {}..", ft.name));
+    {
+      nsprofile::span span{"fetch build", ft.name};
+      nsprocess::cmake_build(bc, "", xpb);
+    }
+    stamp = build_stamp(xpb);
+  }
 
-  nsprocess::cmake_build(bc, "", xpb);
-  nsprocess::cmake_install(bc, cmake::path(dsdk), xpb);
-  installer.installed((xpb / "install_manifest.txt").string());
+  // Fetches build at once but install one at a time, they share the sdk dir and the install cache
+  std::unique_lock         guard{*bc.sdk_lock};
+  std::vector<std::string> to_store;
+  if (!restored)
+  {
+    // Nothing was built since the last install, and everything it installed is still there
+    auto install_id = fmt::format("fetch_install/{}", ft.name);
+    if (configured || stamp.empty() || !bc.state_db->matches(install_id, stamp) || !is_installed(manifest))
+    {
+      nsprofile::span span{"fetch install", ft.name};
+      bc.state_db->erase(install_id);
+      nsprocess::cmake_install(bc, cmake::path(dsdk), xpb);
+      if (!stamp.empty())
+        bc.state_db->put(install_id, stamp);
+    }
+    else if (bc.verbose)
+      nslog::print(fmt::format("Already Installed : {}..", ft.name));
+    // Packed once the lock is released, other fetches install meanwhile
+    if (!key.empty())
+      to_store = nsbincache::installed_files(dsdk, manifest);
+  }
+  installer.reinstalled(manifest.string());
   // custom location copy
   if (!ft.runtime_loc.empty())
   {
+    // Compiled once for every file of every location
+    std::vector<nsmatcher> runtime_files;
+    runtime_files.reserve(ft.runtime_files.size());
+    for (auto const& rt : ft.runtime_files)
+      runtime_files.emplace_back(rt, true);
     for (auto const& l : ft.runtime_loc)
     {
       namespace fs = std::filesystem;
@@ -1301,8 +1515,7 @@ void nsmodule::build_fetched_content(nsbuild const& bc, nsinstallers& installer,
         continue;
       }
 
-      auto       it           = fs::directory_iterator{path};
-      const auto copy_options = fs::copy_options::update_existing | fs::copy_options::recursive;
+      auto it = fs::directory_iterator{path};
       for (auto const& dir_entry : it)
       {
         if (!dir_entry.is_regular_file() && !dir_entry.is_symlink())
@@ -1312,13 +1525,13 @@ void nsmodule::build_fetched_content(nsbuild const& bc, nsinstallers& installer,
           nslog::print(fmt::format("File to copy : {}", name));
         bool copy = false;
 
-        if (std::regex_search(name, bc.dll_ext))
+        if (bc.dll_ext.search(name))
         {
           if (bc.verbose)
             nslog::print(fmt::format("Copying : {}", name));
           auto path = bc.get_full_rt_dir() / "bin";
           std::filesystem::create_directories(path);
-          std::filesystem::copy(dir_entry.path(), path / dir_entry.path().filename(), copy_options);
+          bc.deploy_runtime(dir_entry.path(), path / dir_entry.path().filename());
           continue;
         }
         else if (bc.verbose)
@@ -1328,20 +1541,20 @@ void nsmodule::build_fetched_content(nsbuild const& bc, nsinstallers& installer,
           continue;
 
         name = dir_entry.path().generic_string();
-        for (auto const& rt : ft.runtime_files)
+        for (auto const& rt : runtime_files)
         {
-          std::smatch match;
-          std::regex  rtregex = std::regex(rt, std::regex_constants::icase);
-          if (!std::regex_search(name, match, rtregex))
+          std::size_t start = 0, length = 0;
+          if (!rt.find(name, start, length))
             continue;
-          if (match.empty())
-            continue;
-          std::filesystem::copy(dir_entry.path(), bc.get_full_rt_dir() / match[0].str(), copy_options);
+          bc.deploy_runtime(dir_entry.path(), bc.get_full_rt_dir() / name.substr(start, length));
           break;
         }
       }
     }
   }
+
+  guard.unlock();
+  nsbincache::store(bc, key, dsdk, to_store);
 }
 
 std::filesystem::path nsmodule::get_full_bld_dir(nsbuild const& bc) const
@@ -1367,11 +1580,6 @@ std::filesystem::path nsmodule::get_fetch_src_dir(nsbuild const& bc, nsfetch con
   return (path / nfc.source);
 }
 
-std::filesystem::path nsmodule::get_full_fetch_file(nsbuild const& bc, nsfetch const& nfc) const
-{
-  return bc.get_full_cache_dir() / fmt::format("{}.fetch", nfc.name);
-}
-
 std::filesystem::path nsmodule::get_full_gen_dir(nsbuild const& bc) const
 {
   return bc.get_full_cfg_dir() / k_gen_dir / framework_name / name;
@@ -1405,21 +1613,28 @@ bool nsmodule::restore_fetch_lists(nsbuild const& bc, nsfetch const& ft) const
 
 bool nsmodule::download(nsbuild const& bc, nsfetch& ft)
 {
-  auto dld = get_full_dl_dir(bc, ft);
-  if ((std::filesystem::exists(get_fetch_src_dir(bc, ft) / "CMakeLists.txt")) && !ft.regenerate && !ft.force_download)
+  if (!ft.downloaded && !needs_download(bc, ft))
     return false;
+  // Sources prefetched before processing only need the old build deleted
+  if (!ft.downloaded)
+    download_source(bc, ft);
+
+  if (!deleted)
+    delete_build(bc);
+  return true;
+}
+
+void nsmodule::download_source(nsbuild const& bc, nsfetch const& ft) const
+{
+  nsprofile::span span{"fetch download", ft.name};
   if (ft.repo.ends_with(".git"))
-    nsprocess::git_clone(bc, get_full_dl_dir(bc, ft), ft.repo, ft.tag);
+    nsprocess::git_clone(bc, get_full_dl_dir(bc, ft), ft.repo, ft.tag, ft.commit, ft.source);
   else
   {
     if (!nsprocess::download(bc, get_full_dl_dir(bc, ft), ft.repo, ft.source, ft.version, ft.force_download) &&
         !restore_fetch_lists(bc, ft))
       nsprocess::download(bc, get_full_dl_dir(bc, ft), ft.repo, ft.source, ft.version, true);
   }
-
-  if (!deleted)
-    delete_build(bc);
-  return true;
 }
 
 void nsmodule::write_sha(nsbuild const& bc)
@@ -1431,29 +1646,92 @@ void nsmodule::write_sha(nsbuild const& bc)
   }
 }
 
-bool nsmodule::sha_changed(nsbuild const& bc, std::string_view name, std::string_view isha) const
+void nsmodule::pending_globs(nsbuild const& bc, std::vector<nsglob*>& globs)
+{
+  if (!globs_deferred)
+    return;
+  if (has_data(type))
+    globs.push_back(&glob_media);
+  if (has_runtime(type) && !bc.s_current_preset->glob_sources)
+    globs.push_back(&glob_sources);
+}
+
+void nsmodule::update_glob_shas(nsbuild const& bc)
 {
-  auto          meta = bc.get_full_cache_dir() / fmt::format("{}.{}.{}.glob", framework_name, this->name, name);
-  std::ifstream iff{meta};
-  if (iff.is_open())
+  if (!globs_deferred)
+    return;
+  globs_deferred = false;
+
+  if (has_data(type))
   {
-    std::string sha;
-    iff >> sha;
-    if (sha == isha)
-      return false;
+    if ((has_globs_changed |= sha_changed(bc, "data_group", glob_media.sha)))
+      write_sha_changed(bc, "data_group", glob_media.sha);
+    // Without a manifest the CMakeLists.txt may still call --copy-media with the text artefact of older versions
+    has_globs_changed |= !std::filesystem::exists(get_full_gen_dir(bc) / "media.manifest");
+    write_media_manifest(bc);
   }
-  return true;
+
+  if (has_runtime(type) && !bc.s_current_preset->glob_sources)
+  {
+    if ((has_globs_changed |= sha_changed(bc, "src", glob_media.sha)))
+      write_sha_changed(bc, "src", glob_media.sha);
+  }
+}
+
+void nsmodule::write_media_manifest(nsbuild const& bc) const
+{
+  nsprofile::span  span{"media manifest", name};
+  nsmedia_manifest manifest;
+  auto             root = std::filesystem::absolute(glob_media.sub_paths.back()).lexically_normal();
+  glob_media.files.for_each_relative(root, [&manifest](std::string_view dir, std::string_view leaf)
+                                     { manifest.entries.push_back({fmt::format("{}{}", dir, leaf)}); });
+
+  // Digests come from the stat cache, only files that changed since the last check are read
+  nsparallel::for_each(manifest.entries.size(),
+                       [&](std::size_t i)
+                       {
+                         auto&              e    = manifest.entries[i];
+                         auto               file = root / e.path;
+                         nsstatcache::stamp st;
+                         if (!nsstatcache::get_stamp(file, st))
+                           return;
+                         e.size      = st.size;
+                         e.mtime_ns  = st.mtime_ns;
+                         auto digest = bc.stat_cache->digest(file);
+                         std::from_chars(digest.data(), digest.data() + digest.size(), e.hash, 16);
+                       });
+  manifest.write(get_full_gen_dir(bc) / "media.manifest");
+}
+
+bool nsmodule::sha_changed(nsbuild const& bc, std::string_view name, std::string_view isha) const
+{
+  return !bc.state_db->matches(fmt::format("glob/{}.{}.{}", framework_name, this->name, name), isha);
 }
 
 void nsmodule::write_sha_changed(nsbuild const& bc, std::string_view name, std::string_view isha) const
 {
-  auto          meta = bc.get_full_cache_dir() / fmt::format("{}.{}.{}.glob", framework_name, this->name, name);
-  std::ofstream off{meta};
-  if (off.is_open())
-    off << isha;
+  bc.state_db->put(fmt::format("glob/{}.{}.{}", framework_name, this->name, name), isha);
+}
+
+void ns_embed_content::emplace_back(std::string_view name, std::string_view value, std::filesystem::path file)
+{
+  files.emplace_back(std::string(name), std::string(value), std::move(file));
+}
+
+void ns_embed_content::generate(generated& out) const
+{
+  for (auto const& f : files)
+  {
+    auto file = std::ifstream(f.file, std::ios::binary);
+    if (!file.is_open())
+      continue;
+    auto content = std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    nsprofile::touch(content.size());
+    out.emplace_back(f.name, f.value, std::move(content));
+  }
 }
 
-void ns_embed_content::emplace_back(std::string_view name, std::string_view value, std::string file)
+void ns_embed_content::generated::emplace_back(std::string_view name, std::string_view value, std::string file)
 {
 
   auto name_ = to_upper_camel_case(name);
@@ -72,6 +72,8 @@ void nspreset::write(std::ostream& ff, std::uint32_t options, nameval_list const
     for (auto const& d : extras)
       cache_vars[d.first] = d.second;
     cfg["installDir"] = std::string{"${sourceDir}/"} + bc.out_dir + "/" + cxx.name + "/" + bc.sdk_dir;
+    if (cxx.runtime_deploy == deploy_mode::rpath)
+      cache_vars["CMAKE_BUILD_RPATH"] = cfg["installDir"].get<std::string>() + "/lib";
     configurations.emplace_back(std::move(cfg));
   }
 
@@ -120,6 +122,8 @@ void nspreset::write(std::ostream& ff, std::uint32_t options, std::string_view b
         cache_vars[d.first] = d.second;
 
       cfg["installDir"] = bc.get_full_sdk_dir();
+      if (cxx.runtime_deploy == deploy_mode::rpath)
+        cache_vars["CMAKE_BUILD_RPATH"] = cmake::path(bc.get_full_sdk_dir() / "lib");
       configurations.emplace_back(std::move(cfg));
       break;
     }
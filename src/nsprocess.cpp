@@ -1,16 +1,80 @@
 
+#include <algorithm>
 #include <fmt/format.h>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nsarchive.h>
 #include <nsbuild.h>
 #include <nscmake.h>
+#include <nshash.h>
+#include <nsjobserver.h>
 #include <nslog.h>
+#include <nsmmap.h>
 #include <nsprocess.h>
 #include <reproc++/reproc.hpp>
 #include <reproc++/run.hpp>
 #include <system_error>
 
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__))
+extern char** environ;
+#endif
+
 namespace nsprocess
 {
+namespace
+{
+using environment = std::vector<std::pair<std::string, std::string>>;
+
+/// @brief The environment of this process with the variables in extra replaced
+environment extend_environment(environment const& extra)
+{
+  environment result;
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__))
+  for (auto e = environ; e && *e; ++e)
+  {
+    std::string_view var{*e};
+    auto             eq   = var.find('=');
+    auto             name = var.substr(0, eq);
+    if (eq == var.npos || std::ranges::any_of(extra, [name](auto const& x) { return x.first == name; }))
+      continue;
+    result.emplace_back(name, var.substr(eq + 1));
+  }
+#endif
+  result.insert(result.end(), extra.begin(), extra.end());
+  return result;
+}
+
+/// @brief Fetches of the same repository download at once, they take turns updating its mirror
+std::mutex& mirror_lock(std::filesystem::path const& mirror)
+{
+  static std::mutex                                         guard;
+  static std::map<std::string, std::unique_ptr<std::mutex>> locks;
+  std::scoped_lock                                          lock{guard};
+  auto&                                                     m = locks[mirror.string()];
+  if (!m)
+    m = std::make_unique<std::mutex>();
+  return *m;
+}
+
+/// @brief dl/.mirrors/<name>-<url hash>, one bare repository per upstream url
+std::filesystem::path mirror_path(nsbuild const& bc, std::string_view repo)
+{
+  auto name = repo;
+  while (name.ends_with('/') || name.ends_with('\\'))
+    name.remove_suffix(1);
+  if (name.ends_with(".git"))
+    name.remove_suffix(4);
+  while (name.ends_with('/') || name.ends_with('\\'))
+    name.remove_suffix(1);
+  name = name.substr(name.find_last_of("/:\\") + 1);
+  if (name.empty())
+    name = "repo";
+  return bc.get_full_dl_dir() / ".mirrors" / fmt::format("{}-{}", name, nshash::fast_hex(repo).substr(0, 16));
+}
+} // namespace
 
 void cmake_config(nsbuild const& bc, std::vector<std::string> args, std::string src, std::filesystem::path wd)
 {
@@ -62,62 +126,268 @@ std::vector<std::string> make_args(Args&&... args)
   return result;
 }
 
+namespace
+{
+/// @brief Name of the downloaded archive, its extension follows the url
+std::string archive_name(std::string_view repo, std::string_view name, std::string_view version)
+{
+  auto             url = repo.substr(0, repo.find_first_of("?#"));
+  std::string_view ext = ".zip";
+  for (std::string_view e : {".tar.gz", ".tgz", ".tar.xz", ".txz", ".tar.zst", ".tzst", ".tar", ".zip"})
+  {
+    if (url.ends_with(e))
+    {
+      ext = e;
+      break;
+    }
+  }
+  return fmt::format("{}{}", name.empty() ? version.empty() ? "source" : version : name, ext);
+}
+
+/// @brief The archive a file:// url names, it is extracted from where it is
+std::filesystem::path local_file(std::string_view repo)
+{
+  constexpr std::string_view k_scheme = "file://";
+  if (!repo.starts_with(k_scheme))
+    return {};
+  auto path = repo.substr(k_scheme.size());
+  // file:///C:/sdk.zip
+  if (path.size() > 2 && path[0] == '/' && path[2] == ':')
+    path.remove_prefix(1);
+  return std::filesystem::path(path);
+}
+
+std::string archive_digest(std::filesystem::path const& archive)
+{
+  nsmapped_file file{archive};
+  if (!file.is_open())
+    throw std::runtime_error(fmt::format("Cannot read {}", archive.generic_string()));
+  return nshash::fast_hex(file.view());
+}
+
+/// @brief True once the partial clone settings were written to the config of the repository in git_dir
+bool is_partial(std::filesystem::path const& git_dir)
+{
+  std::ifstream config{git_dir / "config"};
+  std::string   line;
+  while (std::getline(config, line))
+  {
+    if (line.find("promisor") != line.npos)
+      return true;
+  }
+  return false;
+}
+
+/// @brief Blobs are left out of every fetch from origin, the ones a checkout needs are downloaded on demand
+void make_partial(nsbuild const& bc, std::filesystem::path const& wd)
+{
+  git(bc, make_args("config", "core.repositoryformatversion", "1"), wd);
+  git(bc, make_args("config", "extensions.partialClone", "origin"), wd);
+  git(bc, make_args("config", "remote.origin.promisor", "true"), wd);
+  git(bc, make_args("config", "remote.origin.partialclonefilter", "blob:none"), wd);
+}
+
+/// @brief Refs are loose after a fetch, and packed once git gc ran in the mirror
+bool has_ref(std::filesystem::path const& mirror, std::string const& ref)
+{
+  if (std::filesystem::exists(mirror / ref))
+    return true;
+  std::ifstream packed{mirror / "packed-refs"};
+  std::string   line;
+  while (std::getline(packed, line))
+  {
+    if (line.ends_with(ref) && line.size() > ref.size() && line[line.size() - ref.size() - 1] == ' ')
+      return true;
+  }
+  return false;
+}
+
+/// @brief Moves the objects a checkout downloaded into the mirror. Every checkout borrows them from there, a second
+/// fetch dir or a checkout made again does not download them and works without upstream.
+void keep_objects(std::filesystem::path const& dl, std::filesystem::path const& mirror)
+{
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  auto            from = dl / ".git" / "objects";
+  auto            to   = mirror / "objects";
+  auto            move = [&ec](fs::path const& file, fs::path const& dest)
+  {
+    // Object and pack names are their content hashes, one that is there already is the same
+    if (fs::exists(dest, ec))
+      fs::remove(file, ec);
+    else
+      fs::rename(file, dest, ec);
+  };
+
+  std::vector<fs::path> found;
+  for (auto const& e : fs::directory_iterator(from / "pack", ec))
+    if (e.path().extension() == ".idx")
+      found.push_back(e.path());
+  std::scoped_lock lock{mirror_lock(mirror)};
+  for (auto const& idx : found)
+  {
+    // A pack is looked up through its index, it goes last
+    for (auto const* ext : {".pack", ".rev", ".promisor", ".idx"})
+    {
+      auto file = idx;
+      file.replace_extension(ext);
+      if (fs::exists(file, ec))
+        move(file, to / "pack" / file.filename());
+    }
+  }
+
+  // Small fetches are unpacked into loose objects
+  found.clear();
+  for (auto const& d : fs::directory_iterator(from, ec))
+  {
+    if (d.path().filename().string().size() != 2)
+      continue;
+    for (auto const& o : fs::directory_iterator(d.path(), ec))
+      found.push_back(o.path());
+  }
+  for (auto const& o : found)
+  {
+    auto dir = to / o.parent_path().filename();
+    fs::create_directories(dir, ec);
+    move(o, dir / o.filename());
+  }
+}
+
+/// @brief Checks the commit the mirror holds in ref out in dl, a repository that borrows the mirror's objects. Only
+/// the sparse directory is checked out when there is one, and only its blobs are downloaded.
+void checkout(nsbuild const& bc, std::filesystem::path const& dl, std::filesystem::path const& mirror,
+              std::string_view repo, std::string const& ref, std::string_view sparse)
+{
+  std::error_code ec;
+  auto            git_dir = dl / ".git";
+  if (!std::filesystem::exists(git_dir))
+  {
+    // Whatever is left there is not a checkout
+    std::filesystem::remove_all(dl, ec);
+    git(bc, make_args("init", "--quiet", "."), dl);
+  }
+  // What git clone --reference sets up, objects already in the mirror are never copied
+  {
+    std::ofstream alternates{git_dir / "objects" / "info" / "alternates"};
+    alternates << cmake::path(mirror / "objects") << "\n";
+  }
+  git(bc, make_args("config", "remote.origin.url", repo), dl);
+  git(bc, make_args("config", "remote.mirror.url", cmake::path(mirror)), dl);
+  if (!is_partial(git_dir))
+    make_partial(bc, dl);
+  if (!sparse.empty())
+    git(bc, make_args("sparse-checkout", "set", "--cone", sparse), dl);
+  else if (std::filesystem::exists(git_dir / "info" / "sparse-checkout"))
+    git(bc, make_args("sparse-checkout", "disable"), dl);
+
+  // Everything is in the mirror already, nothing is transferred
+  git(bc, make_args("fetch", "--quiet", "--no-tags", "mirror", ref), dl);
+  git(bc, make_args("reset", "--quiet", "--hard", "FETCH_HEAD"), dl);
+  git(bc,
+      make_args("submodule", "update", "--init", "--recursive", "--depth=1", "--filter=blob:none",
+                fmt::format("--jobs={}", std::max<std::uint32_t>(bc.fetch_jobs, 1))),
+      dl);
+  git(bc, make_args("clean", "-dfx"), dl);
+}
+} // namespace
+
 bool download(nsbuild const& bc, std::filesystem::path const& dl, std::string_view const& repo, std::string_view name,
               std::string_view version, bool force)
 {
-  auto zip =
-      name.empty() ? version.empty() ? "source.zip" : fmt::format("{}.zip", version) : fmt::format("{}.zip", name);
-  if (std::filesystem::exists(dl / zip) && (!name.empty() || !version.empty()) && !force)
-    return false;
+  auto local   = local_file(repo);
+  auto file    = archive_name(repo, name, version);
+  auto archive = local.empty() ? dl / file : local;
+  std::filesystem::create_directories(dl);
+  if (local.empty())
+  {
+    if (std::filesystem::exists(archive) && (!name.empty() || !version.empty()) && !force)
+      return false;
 
-  if (!std::filesystem::exists(dl / zip) || name.empty())
+    if (!std::filesystem::exists(archive) || name.empty())
 #ifdef _WIN64
-    powershell(bc, make_args(std::format("Invoke-RestMethod -URI {} -OutFile {}", repo, zip)), dl);
+      powershell(bc, make_args(std::format("Invoke-RestMethod -URI {} -OutFile {}", repo, file)), dl);
 #else
-    execute("curl", bc, make_args("-L", "-o", zip, repo), dl);
+      execute("curl", bc, make_args("-L", "-o", file, repo), dl);
 #endif
+  }
+  else if (!std::filesystem::exists(archive))
+    throw std::runtime_error(fmt::format("{} does not exist", repo));
+
+  // The digest of the archive that was last extracted in dl
+  auto        marker = dl / ".nsarchive";
+  auto        digest = archive_digest(archive);
+  std::string last;
+  std::ifstream{marker} >> last;
+  if (digest == last)
+  {
+    if (!force)
+      return false;
+    // Everything is extracted already, only the build files nsbuild writes over are restored
+    std::vector<std::string> lists;
+    for (auto const* f : {"CMakeLists.txt", "CMakePresets.json"})
+      lists.emplace_back((std::filesystem::path(name) / f).generic_string());
+    if (nsarchive::extract(archive, dl, lists))
+      return true;
+  }
+
   std::error_code ec;
   // remove source file and any existing directories
   auto dir = std::filesystem::directory_iterator(dl);
   for (auto const& d : dir)
   {
-    if (d.path().filename() != zip)
+    if (d.path().filename() != file)
       std::filesystem::remove_all(d.path(), ec);
   }
 
-#ifdef _WIN64
-  powershell(bc, make_args(std::format("Expand-Archive -Path {} -DestinationPath . -Force", zip)), dl);
-#else
-  execute("unzip", bc, make_args("-o", zip), dl);
-#endif
+  // Formats this build cannot read are left to cmake
+  if (!nsarchive::extract(archive, dl))
+    cmake(bc, make_args("-E", "tar", "xf", cmake::path(archive)), dl);
+  std::ofstream{marker} << digest << "\n";
   return true;
 }
 
-void git_clone(nsbuild const& bc, std::filesystem::path const& dl, std::string_view const& repo, std::string_view tag)
+void git_clone(nsbuild const& bc, std::filesystem::path const& dl, std::string_view const& repo, std::string_view tag,
+               std::string_view commit, std::string_view source)
 {
-  std::error_code ec;
-  if (!std::filesystem::exists(dl) || std::filesystem::is_empty(dl, ec))
+  auto mirror = mirror_path(bc, repo);
+  auto what   = commit.empty() ? tag : commit;
+  // The tag, branch or commit is kept under its own ref, fetches of other tags of the repo leave it alone
+  auto ref    = fmt::format("refs/nsbuild/{}", what);
   {
-    git(bc, make_args("clone", repo, "--recurse-submodules", "--shallow-submodules", "--branch", tag, "--depth=1", "."),
-        dl);
+    std::scoped_lock lock{mirror_lock(mirror)};
+    if (!std::filesystem::exists(mirror / "HEAD"))
+      git(bc, make_args("init", "--quiet", "--bare", "."), mirror);
+    if (!is_partial(mirror))
+      make_partial(bc, mirror);
+    git(bc, make_args("config", "remote.origin.url", repo), mirror);
+    // A commit never moves, once the mirror has it there is nothing to download. Otherwise only the commit and its
+    // trees are downloaded, the blobs come with the checkout and are then kept in the mirror.
+    if (commit.empty() || !has_ref(mirror, ref))
+      git(bc,
+          make_args("fetch", "--no-tags", "--force", "--depth=1", "--filter=blob:none", "origin",
+                    fmt::format("{}:{}", what, ref)),
+          mirror);
   }
-  else
+
+  auto sparse = std::filesystem::path(source).lexically_normal().generic_string();
+  while (sparse.ends_with('/'))
+    sparse.pop_back();
+  if (sparse == ".")
+    sparse.clear();
+
+  try
   {
-    try
-    {
-      git(bc, make_args("remote", "set-url", "origin", repo), dl);
-      git(bc, make_args("fetch", "--depth=1", "origin", "--recurse-submodules=yes", tag), dl);
-      git(bc, make_args("reset", "--hard", "FETCH_HEAD"), dl);
-      git(bc, make_args("submodule", "update"), dl);
-      git(bc, make_args("clean", "-dfx"), dl);
-    }
-    catch (std::exception&)
-    {
-      // try another way
-      std::filesystem::remove_all(dl);
-      git_clone(bc, dl, repo, tag);
-    }
+    checkout(bc, dl, mirror, repo, ref, sparse);
+  }
+  catch (std::exception&)
+  {
+    // A broken checkout is made again from the mirror, nothing is downloaded twice
+    nslog::warn(fmt::format("Checking out {} again", cmake::path(dl)));
+    keep_objects(dl, mirror);
+    std::filesystem::remove_all(dl);
+    checkout(bc, dl, mirror, repo, ref, sparse);
   }
+  keep_objects(dl, mirror);
 }
 
 void execute(std::string_view name, nsbuild const& bc, std::vector<std::string> args, std::filesystem::path wd)
@@ -128,18 +398,23 @@ void execute(std::string_view name, nsbuild const& bc, std::vector<std::string>
   for (auto const& a : args)
     sargs.emplace_back(a.c_str());
   sargs.emplace_back(nullptr);
-  auto save = std::filesystem::current_path();
   std::filesystem::create_directories(wd);
-  std::filesystem::current_path(wd);
+  // The child starts in wd, the process directory is left alone so fetches can download at once
+  auto dir = wd.string();
 
   reproc::arguments pargs{sargs.data()};
-  reproc::process   proc;
   reproc::options   default_opt;
 
-  default_opt.redirect.parent = true;
+  default_opt.redirect.parent   = true;
+  default_opt.working_directory = dir.c_str();
+  // Children of a fetch build find the jobserver nsbuild serves, variables already set are replaced not repeated
+  if (bc.jobserver && !bc.jobserver->environment().empty())
+  {
+    default_opt.env.behavior = reproc::env::empty;
+    default_opt.env.extra    = extend_environment(bc.jobserver->environment());
+  }
 
-  auto [status, rc] = reproc::run(pargs);
-  std::filesystem::current_path(save);
+  auto [status, rc] = reproc::run(pargs, default_opt);
 
   std::string msg = rc.message();
   if (rc || status != 0)
@@ -0,0 +1,203 @@
+#include "nsprofile.h"
+
+#include "nslog.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace nsprofile
+{
+namespace
+{
+struct event
+{
+  std::string   name;
+  std::string   detail;
+  std::int64_t  start_us = 0;
+  std::int64_t  dur_us   = 0;
+  std::uint64_t bytes    = 0;
+  std::uint64_t files    = 0;
+  std::uint32_t tid      = 0;
+};
+
+struct recorder
+{
+  std::mutex                            lock;
+  std::vector<event>                    events;
+  std::filesystem::path                 file;
+  std::chrono::steady_clock::time_point origin;
+  std::atomic<std::uint32_t>            threads = 0;
+};
+
+std::atomic<bool> s_enabled = false;
+
+recorder& get_recorder()
+{
+  static recorder r;
+  return r;
+}
+
+thread_local span*         t_current = nullptr;
+thread_local std::uint32_t t_tid     = 0;
+
+std::int64_t now_us()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                               get_recorder().origin)
+      .count();
+}
+
+std::uint32_t thread_id()
+{
+  if (!t_tid)
+    t_tid = ++get_recorder().threads;
+  return t_tid;
+}
+
+void write_escaped(std::ostream& os, std::string_view s)
+{
+  os << '"';
+  for (char c : s)
+  {
+    switch (c)
+    {
+    case '"':
+      os << "\\\"";
+      break;
+    case '\\':
+      os << "\\\\";
+      break;
+    case '\n':
+      os << "\\n";
+      break;
+    case '\t':
+      os << "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20)
+        os << fmt::format("\\u{:04x}", static_cast<unsigned>(c));
+      else
+        os << c;
+    }
+  }
+  os << '"';
+}
+} // namespace
+
+void start(std::filesystem::path file)
+{
+  auto& r = get_recorder();
+  {
+    std::scoped_lock guard{r.lock};
+    r.file   = std::filesystem::absolute(std::move(file));
+    r.origin = std::chrono::steady_clock::now();
+    r.events.clear();
+  }
+  s_enabled.store(true, std::memory_order_release);
+}
+
+bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+void finish()
+{
+  if (!s_enabled.exchange(false))
+    return;
+
+  auto&            r = get_recorder();
+  std::scoped_lock guard{r.lock};
+  std::ofstream    ofs{r.file};
+  if (!ofs)
+  {
+    nslog::error(fmt::format("Could not write profile: {}", r.file.generic_string()));
+    return;
+  }
+
+  ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  for (std::uint32_t t = 1; t <= r.threads; ++t)
+  {
+    ofs << (first ? "\n" : ",\n")
+        << fmt::format("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}", t,
+                       t == 1 ? std::string("nsbuild") : fmt::format("worker {}", t - 1));
+    first = false;
+  }
+  for (auto const& e : r.events)
+  {
+    ofs << (first ? "\n" : ",\n") << "{\"name\":";
+    write_escaped(ofs, e.name);
+    ofs << fmt::format(",\"cat\":\"nsbuild\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{},\"dur\":{},\"args\":{{", e.tid,
+                       e.start_us, e.dur_us);
+    if (!e.detail.empty())
+    {
+      ofs << "\"detail\":";
+      write_escaped(ofs, e.detail);
+      ofs << ",";
+    }
+    ofs << fmt::format("\"bytes_read\":{},\"files\":{}}}}}", e.bytes, e.files);
+    first = false;
+  }
+  ofs << "\n]}\n";
+  r.events.clear();
+  nslog::print(fmt::format("Profile written to {}", r.file.generic_string()));
+}
+
+void touch(std::uint64_t bytes_read, std::uint64_t files)
+{
+  if (auto s = t_current)
+  {
+    s->bytes += bytes_read;
+    s->files += files;
+  }
+}
+
+span::span(std::string_view name, std::string_view detail)
+{
+  if (!enabled())
+    return;
+  this->detail = detail;
+  begin(name);
+}
+
+span::span(std::string_view name, std::filesystem::path const& detail)
+{
+  if (!enabled())
+    return;
+  this->detail = detail.generic_string();
+  begin(name);
+}
+
+void span::begin(std::string_view name)
+{
+  // Numbers threads in the order they first open a span, the main thread comes first
+  thread_id();
+  this->name = name;
+  active     = true;
+  parent     = t_current;
+  t_current  = this;
+  start_us   = now_us();
+}
+
+span::~span()
+{
+  if (!active)
+    return;
+  auto end  = now_us();
+  t_current = parent;
+  if (parent)
+  {
+    parent->bytes += bytes;
+    parent->files += files;
+  }
+
+  auto& r = get_recorder();
+  auto  e = event{std::move(name), std::move(detail), start_us, end - start_us, bytes, files, thread_id()};
+
+  std::scoped_lock guard{r.lock};
+  if (enabled())
+    r.events.emplace_back(std::move(e));
+}
+
+} // namespace nsprofile
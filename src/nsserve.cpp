@@ -0,0 +1,434 @@
+#include "nsserve.h"
+
+#include "nsbuild.h"
+#include "nshash.h"
+#include "nslog.h"
+#include "nsprocess.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__))
+#define NS_SERVE_POSIX
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+extern int nsbuild_main(nsbuild& build, int argc, char const* argv[]);
+
+namespace nsserve
+{
+
+std::filesystem::path socket_path(std::filesystem::path const& source)
+{
+  std::error_code ec;
+  auto            canon = std::filesystem::canonical(source, ec);
+  if (ec)
+    canon = std::filesystem::absolute(source);
+  // Socket paths are limited to ~100 characters, keep it out of the source tree
+  char const*           runtime = std::getenv("XDG_RUNTIME_DIR");
+  std::filesystem::path dir     = (runtime && *runtime) ? std::filesystem::path(runtime)
+                                                        : std::filesystem::temp_directory_path(ec);
+  return dir / fmt::format("nsbuild-{}.sock", nshash::fast_hex(canon.generic_string()));
+}
+
+#ifdef NS_SERVE_POSIX
+namespace
+{
+volatile std::sig_atomic_t s_stop = 0;
+
+void on_stop(int) { s_stop = 1; }
+
+struct input_stamp
+{
+  std::int64_t  mtime_ns = 0;
+  std::uint64_t size     = 0;
+  std::uint64_t inode    = 0;
+  bool          exists   = false;
+
+  bool operator==(input_stamp const&) const = default;
+};
+
+/// @brief What the daemon remembers per distinct check command line
+struct session
+{
+  std::shared_ptr<nsstatcache>                     stat_cache = std::make_shared<nsstatcache>();
+  std::shared_ptr<nsdircache>                      dir_cache  = std::make_shared<nsdircache>();
+  std::shared_ptr<nsstatedb>                       state_db   = std::make_shared<nsstatedb>();
+  std::vector<std::pair<std::string, input_stamp>> inputs;
+  bool                                             valid = false;
+};
+
+input_stamp stamp_of(std::string const& path)
+{
+  input_stamp s;
+  struct stat sb;
+  if (::stat(path.c_str(), &sb) == 0)
+  {
+#ifdef __APPLE__
+    auto const& mtime = sb.st_mtimespec;
+#else
+    auto const& mtime = sb.st_mtim;
+#endif
+    s.mtime_ns = static_cast<std::int64_t>(mtime.tv_sec) * 1'000'000'000 + mtime.tv_nsec;
+    s.size     = static_cast<std::uint64_t>(sb.st_size);
+    s.inode    = static_cast<std::uint64_t>(sb.st_ino);
+    s.exists   = true;
+  }
+  return s;
+}
+
+bool unchanged(session const& s)
+{
+  if (!s.valid)
+    return false;
+  return std::ranges::all_of(s.inputs, [](auto const& i) { return stamp_of(i.first) == i.second; });
+}
+
+/// @brief Every file the check read and every directory whose listing it depends on. Directories catch added or
+/// removed modules, sources and media, files catch edits. Generated directories catch deleted outputs.
+void record_inputs(session& s, nsbuild const& bc, std::filesystem::path const& source)
+{
+  s.valid = false;
+  std::vector<std::string> paths;
+  auto                     add = [&paths](std::filesystem::path const& p) { paths.emplace_back(p.generic_string()); };
+
+  add(source / "Build.ns");
+  add(bc.get_full_source_dir() / bc.frameworks_dir);
+  for (auto const& fw : bc.frameworks)
+  {
+    auto fwdir = bc.get_full_source_dir() / bc.frameworks_dir / fw.name;
+    add(fwdir);
+    add(fwdir / "Framework.ns");
+    for (auto const& m : fw.modules)
+    {
+      add(m.location);
+      if (m.disabled)
+        continue;
+      // Globs skipped through the watch journal leave no directories to watch, the next check will be cheap anyway
+      if (m.globs_deferred)
+        return;
+      add(m.get_full_gen_dir(bc));
+      add(m.get_full_gen_dir(bc) / "local");
+      for (auto const& d : m.glob_media.dirs)
+        add(d);
+      for (auto const& d : m.glob_sources.dirs)
+        add(d);
+      for (auto const& ft : m.fetch)
+        add(m.get_fetch_src_dir(bc, ft) / "CMakeLists.txt");
+    }
+  }
+  s.stat_cache->for_each_used([&paths](std::string const& p) { paths.emplace_back(p); });
+  add(bc.get_full_cache_dir() / "compiler.ns");
+  // Written last by the check itself, a change means another nsbuild run in between
+  add(bc.get_full_cache_dir() / "state.db");
+  add(bc.get_full_cmake_gen_dir() / "CMakeLists.txt");
+
+  std::ranges::sort(paths);
+  paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+  s.inputs.clear();
+  s.inputs.reserve(paths.size());
+  for (auto& p : paths)
+  {
+    auto st = stamp_of(p);
+    s.inputs.emplace_back(std::move(p), st);
+  }
+  s.valid = true;
+}
+
+bool write_all(int fd, char const* data, std::size_t size)
+{
+  while (size)
+  {
+    auto n = ::write(fd, data, size);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += n;
+    size -= static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+int make_socket()
+{
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0)
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+bool connect_to(std::filesystem::path const& path, int& fd)
+{
+  sockaddr_un addr{};
+  auto        str = path.string();
+  if (str.size() >= sizeof(addr.sun_path))
+    return false;
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, str.c_str(), str.size() + 1);
+
+  fd = make_socket();
+  if (fd < 0)
+    return false;
+  if (::connect(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  return true;
+}
+
+/// @brief Runs the check with stdout and stderr, including child processes, going to the client
+int run_check(session& s, std::filesystem::path const& source, std::vector<std::string> const& args, int client)
+{
+  std::vector<char const*> argv;
+  argv.push_back("nsbuild");
+  for (auto const& a : args)
+    argv.push_back(a.c_str());
+
+  std::fflush(stdout);
+  std::cout.flush();
+  int saved_out = ::dup(1);
+  int saved_err = ::dup(2);
+  ::dup2(client, 1);
+  ::dup2(client, 2);
+
+  int code = -1;
+  try
+  {
+    nsbuild build;
+    build.stat_cache = s.stat_cache;
+    build.dir_cache  = s.dir_cache;
+    build.state_db   = s.state_db;
+    code             = nsbuild_main(build, static_cast<int>(argv.size()), argv.data());
+    if (code == 0)
+      record_inputs(s, build, source);
+    else
+      s.valid = false;
+  }
+  catch (...)
+  {
+    s.valid = false;
+  }
+
+  std::fflush(stdout);
+  std::fflush(stderr);
+  std::cout.flush();
+  std::cerr.flush();
+  ::dup2(saved_out, 1);
+  ::dup2(saved_err, 2);
+  ::close(saved_out);
+  ::close(saved_err);
+  return code;
+}
+
+void handle(int client, std::filesystem::path const& source, std::unordered_map<std::string, session>& sessions)
+{
+  // Request: cwd and arguments, each terminated by a NUL, until the client shuts down its side
+  std::string request;
+  char        buffer[4096];
+  while (true)
+  {
+    auto n = ::read(client, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    request.append(buffer, static_cast<std::size_t>(n));
+  }
+
+  std::vector<std::string> parts;
+  for (std::size_t pos = 0; pos < request.size();)
+  {
+    auto end = request.find('\0', pos);
+    if (end == std::string::npos)
+      end = request.size();
+    parts.emplace_back(request.substr(pos, end - pos));
+    pos = end + 1;
+  }
+  if (parts.empty())
+    return;
+
+  int  code = -1;
+  auto cwd  = parts.front();
+  parts.erase(parts.begin());
+  if (::chdir(cwd.c_str()) != 0)
+  {
+    auto msg = fmt::format(" -- [!!!] nsbuild --serve could not enter {}\n", cwd);
+    write_all(client, msg.data(), msg.size());
+  }
+  else
+  {
+    auto  key = fmt::format("{}\n{}", cwd, fmt::join(parts, "\n"));
+    auto& s   = sessions[key];
+    if (unchanged(s))
+    {
+      static constexpr std::string_view msg = " -- [ + ] No changes since the last check (nsbuild --serve)\n";
+      write_all(client, msg.data(), msg.size());
+      code = 0;
+    }
+    else
+      code = run_check(s, source, parts, client);
+    nslog::print(fmt::format("check [{}] -> {}", fmt::join(parts, " "), code));
+  }
+
+  // Response: streamed output, a NUL, then the exit code
+  char trailer[1 + sizeof(std::int32_t)] = {};
+  auto value                            = static_cast<std::int32_t>(code);
+  std::memcpy(trailer + 1, &value, sizeof(value));
+  write_all(client, trailer, sizeof(trailer));
+}
+} // namespace
+
+int serve(std::filesystem::path const& source)
+{
+  auto path = socket_path(source);
+  int  fd   = -1;
+  if (connect_to(path, fd))
+  {
+    ::close(fd);
+    nslog::error(fmt::format("nsbuild --serve is already running on {}", path.string()));
+    return -1;
+  }
+
+  sockaddr_un addr{};
+  auto        str = path.string();
+  if (str.size() >= sizeof(addr.sun_path))
+  {
+    nslog::error(fmt::format("Socket path is too long: {}", str));
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, str.c_str(), str.size() + 1);
+
+  ::unlink(str.c_str());
+  fd = make_socket();
+  if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 16) != 0)
+  {
+    nslog::error(fmt::format("Could not listen on {}: {}", str, std::strerror(errno)));
+    if (fd >= 0)
+      ::close(fd);
+    return -1;
+  }
+
+  // No SA_RESTART, accept has to return so the socket gets cleaned up
+  struct sigaction sa
+  {
+  };
+  sa.sa_handler = on_stop;
+  sigemptyset(&sa.sa_mask);
+  ::sigaction(SIGINT, &sa, nullptr);
+  ::sigaction(SIGTERM, &sa, nullptr);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  // Requests chdir to the client's directory, keep the root absolute
+  std::error_code ec;
+  auto            root = std::filesystem::canonical(source, ec);
+  if (ec)
+    root = std::filesystem::absolute(source);
+  nslog::print(fmt::format("Serving {} on {}", root.generic_string(), str));
+  std::fflush(stdout);
+
+  std::unordered_map<std::string, session> sessions;
+  while (!s_stop)
+  {
+    int client = ::accept(fd, nullptr, nullptr);
+    if (client < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      break;
+    }
+    ::fcntl(client, F_SETFD, FD_CLOEXEC);
+    handle(client, root, sessions);
+    ::close(client);
+    std::fflush(stdout);
+  }
+
+  ::close(fd);
+  ::unlink(str.c_str());
+  return 0;
+}
+
+std::optional<int> request(std::filesystem::path const& source, int argc, char const* argv[])
+{
+  int fd = -1;
+  if (!connect_to(socket_path(source), fd))
+    return std::nullopt;
+
+  std::string req = std::filesystem::current_path().string();
+  req.push_back('\0');
+  for (int i = 1; i < argc; ++i)
+  {
+    req += argv[i];
+    req.push_back('\0');
+  }
+  if (!write_all(fd, req.data(), req.size()))
+  {
+    ::close(fd);
+    return std::nullopt;
+  }
+  ::shutdown(fd, SHUT_WR);
+
+  std::string trailer;
+  bool        done = false;
+  char        buffer[4096];
+  while (true)
+  {
+    auto n = ::read(fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    std::string_view chunk{buffer, static_cast<std::size_t>(n)};
+    if (!done)
+    {
+      auto nul = chunk.find('\0');
+      std::fwrite(chunk.data(), 1, std::min(nul, chunk.size()), stdout);
+      if (nul == std::string_view::npos)
+        continue;
+      done  = true;
+      chunk = chunk.substr(nul + 1);
+    }
+    trailer.append(chunk);
+  }
+  std::fflush(stdout);
+  ::close(fd);
+
+  // The daemon went away mid-check, run it locally
+  if (!done || trailer.size() < sizeof(std::int32_t))
+    return std::nullopt;
+  std::int32_t code = 0;
+  std::memcpy(&code, trailer.data(), sizeof(code));
+  return code;
+}
+
+#else
+
+int serve(std::filesystem::path const&)
+{
+  nslog::error("nsbuild --serve is not supported on this platform");
+  return -1;
+}
+
+std::optional<int> request(std::filesystem::path const&, int, char const*[]) { return std::nullopt; }
+
+#endif
+
+} // namespace nsserve
@@ -0,0 +1,294 @@
+#include "nssnapshot.h"
+
+#include "nsmodule.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace nssnapshot
+{
+static inline constexpr char k_magic[] = "NSMS";
+
+struct writer
+{
+  std::string data;
+
+  void raw(void const* p, std::size_t n) { data.append(static_cast<char const*>(p), n); }
+
+  template <typename T>
+    requires std::is_arithmetic_v<T>
+  void operator()(T v)
+  {
+    raw(&v, sizeof(v));
+  }
+
+  template <typename T>
+    requires std::is_enum_v<T>
+  void operator()(T v)
+  {
+    (*this)(static_cast<std::uint32_t>(v));
+  }
+
+  void operator()(std::string_view v)
+  {
+    (*this)(static_cast<std::uint32_t>(v.size()));
+    raw(v.data(), v.size());
+  }
+
+  void operator()(std::string const& v) { (*this)(std::string_view{v}); }
+
+  void operator()(std::filesystem::path const& v) { (*this)(v.generic_string()); }
+};
+
+struct reader
+{
+  std::string_view data;
+  std::size_t      pos = 0;
+
+  char const* raw(std::size_t n)
+  {
+    if (data.size() - pos < n)
+      throw std::out_of_range("Truncated snapshot");
+    auto p = data.data() + pos;
+    pos += n;
+    return p;
+  }
+
+  template <typename T>
+    requires std::is_arithmetic_v<T>
+  void operator()(T& v)
+  {
+    std::memcpy(&v, raw(sizeof(v)), sizeof(v));
+  }
+
+  template <typename T>
+    requires std::is_enum_v<T>
+  void operator()(T& v)
+  {
+    std::uint32_t u = 0;
+    (*this)(u);
+    v = static_cast<T>(u);
+  }
+
+  void operator()(std::string_view& v)
+  {
+    std::uint32_t size = 0;
+    (*this)(size);
+    v = std::string_view{raw(size), size};
+  }
+
+  void operator()(std::string& v)
+  {
+    std::string_view sv;
+    (*this)(sv);
+    v = sv;
+  }
+
+  void operator()(std::filesystem::path& v)
+  {
+    std::string_view sv;
+    (*this)(sv);
+    v = sv;
+  }
+};
+
+// One io() per type serves both directions, the writer never modifies what it is given
+
+template <typename Ar>
+void io(Ar& ar, neo::text_content& v);
+template <typename Ar>
+void io(Ar& ar, nsnamed_params& v);
+template <typename Ar>
+void io(Ar& ar, nsvars& v);
+template <typename Ar>
+void io(Ar& ar, nscontent& v);
+template <typename Ar>
+void io(Ar& ar, nsbuildcmds& v);
+template <typename Ar>
+void io(Ar& ar, nsbuildstep& v);
+template <typename Ar>
+void io(Ar& ar, nsinterface& v);
+template <typename Ar>
+void io(Ar& ar, nstest& v);
+template <typename Ar>
+void io(Ar& ar, nsfilecopy& v);
+template <typename Ar>
+void io(Ar& ar, nsfetch& v);
+template <typename Ar>
+void io(Ar& ar, ns_embed_content::entry& v);
+template <typename Ar>
+void io(Ar& ar, nsmodule& v);
+
+template <typename Ar, typename T>
+  requires(std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_same_v<T, std::string> ||
+           std::is_same_v<T, std::string_view> || std::is_same_v<T, std::filesystem::path>)
+void io(Ar& ar, T& v)
+{
+  ar(v);
+}
+
+template <typename Ar, typename A, typename B>
+void io(Ar& ar, std::pair<A, B>& v)
+{
+  io(ar, v.first);
+  io(ar, v.second);
+}
+
+template <typename Ar, typename T>
+void io(Ar& ar, std::vector<T>& v)
+{
+  auto size = static_cast<std::uint32_t>(v.size());
+  ar(size);
+  v.resize(size);
+  for (auto& e : v)
+    io(ar, e);
+}
+
+template <typename Ar, typename... Args>
+void io_all(Ar& ar, Args&... args)
+{
+  (io(ar, args), ...);
+}
+
+template <typename Ar>
+void io(Ar& ar, neo::text_content& v)
+{
+  io(ar, v.fragments);
+}
+
+template <typename Ar>
+void io(Ar& ar, nsnamed_params& v)
+{
+  io_all(ar, v.name, v.values);
+}
+
+template <typename Ar>
+void io(Ar& ar, nsvars& v)
+{
+  io_all(ar, v.prefix, v.filters, v.params);
+}
+
+template <typename Ar>
+void io(Ar& ar, nscontent& v)
+{
+  io_all(ar, v.name, v.content);
+}
+
+template <typename Ar>
+void io(Ar& ar, nsbuildcmds& v)
+{
+  io_all(ar, v.msgs, v.command, v.params);
+}
+
+template <typename Ar>
+void io(Ar& ar, nsbuildstep& v)
+{
+  io_all(ar, v.artifacts, v.dependencies, v.injected_config_body, v.injected_config_end, v.steps, v.check, v.wd,
+         v.name, v.module_filter);
+}
+
+template <typename Ar>
+void io(Ar& ar, nsinterface& v)
+{
+  io_all(ar, v.filters, v.dependencies, v.sys_libraries, v.definitions);
+}
+
+template <typename Ar>
+void io(Ar& ar, nstest& v)
+{
+  io_all(ar, v.name, v.test_param_name, v.tags, v.parameters);
+}
+
+template <typename Ar>
+void io(Ar& ar, nsfilecopy& v)
+{
+  io_all(ar, v.files, v.dest, v.is_dir_copy);
+}
+
+template <typename Ar>
+void io(Ar& ar, nsfetch& v)
+{
+  io_all(ar, v.name, v.filters, v.finalize, v.prepare, v.include, v.repo, v.license, v.tag, v.commit, v.source,
+         v.version, v.args, v.package, v.extern_name, v.namespace_name, v.components, v.targets, v.runtime_install,
+         v.runtime_loc, v.runtime_files, v.legacy_linking, v.skip_namespace, v.force_build, v.force_download,
+         v.disabled);
+}
+
+template <typename Ar>
+void io(Ar& ar, ns_embed_content::entry& v)
+{
+  io_all(ar, v.name, v.value, v.file);
+}
+
+template <typename Ar>
+void io(Ar& ar, nsmodule& v)
+{
+  io_all(ar, v.exports, v.vars, v.contents, v.prebuild, v.postbuild, v.version, v.references, v.required_plugins,
+         v.source_sub_dirs, v.source_files, v.tests, v.intf[nsmodule::priv_intf], v.intf[nsmodule::pub_intf],
+         v.fetch, v.tags, v.org_name, v.custom_target_name, v.type, v.disabled, v.console_app,
+         v.embedded_binary_files.files, v.embedded_base64_files.files);
+}
+
+bool load(nsmodule& m, std::filesystem::path const& file, std::string_view key, std::list<nsmapped_file>& contents)
+{
+  auto& buffer = contents.emplace_back();
+  if (!buffer.open(file))
+  {
+    contents.pop_back();
+    return false;
+  }
+  try
+  {
+    reader           ar{buffer.view()};
+    std::string_view magic;
+    std::uint32_t    version = 0;
+    std::string_view stored_key;
+    ar(magic);
+    ar(version);
+    ar(stored_key);
+    if (magic != k_magic || version != k_version || stored_key != key)
+    {
+      contents.pop_back();
+      return false;
+    }
+    // Only identity is set before parsing, carry it over once the load is complete
+    nsmodule loaded;
+    io(ar, loaded);
+    loaded.name           = std::move(m.name);
+    loaded.framework_name = std::move(m.framework_name);
+    loaded.location       = std::move(m.location);
+    m                     = std::move(loaded);
+    return true;
+  }
+  catch (std::exception&)
+  {
+    contents.pop_back();
+    return false;
+  }
+}
+
+void save(nsmodule const& m, std::filesystem::path const& file, std::string_view key)
+{
+  writer ar;
+  ar(std::string_view{k_magic});
+  ar(k_version);
+  ar(key);
+  io(ar, const_cast<nsmodule&>(m));
+
+  auto tmp = file;
+  tmp += ".tmp";
+  {
+    std::ofstream off(tmp, std::ios::binary);
+    if (!off.is_open())
+      return;
+    off.write(ar.data.data(), ar.data.size());
+    if (!off)
+      return;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, file, ec);
+}
+
+} // namespace nssnapshot
@@ -0,0 +1,143 @@
+#include "nsstatcache.h"
+
+#include "nshash.h"
+#include "nsprofile.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__))
+#include <sys/stat.h>
+#define NS_POSIX_STAT
+#endif
+
+namespace
+{
+// Bump when the digest algorithm changes, older manifests are dropped
+constexpr char k_header[] = "nsstatcache 2";
+// Files modified this close to the run may change again within the same mtime tick, they are not trusted
+constexpr std::int64_t k_racy_window_ns = 2'000'000'000;
+
+std::int64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+bool nsstatcache::get_stamp(std::filesystem::path const& path, stamp& st)
+{
+#ifdef NS_POSIX_STAT
+  struct stat sb;
+  if (::stat(path.c_str(), &sb) != 0 || !S_ISREG(sb.st_mode))
+    return false;
+  st.size     = static_cast<std::uint64_t>(sb.st_size);
+#ifdef __APPLE__
+  auto const& mtime = sb.st_mtimespec;
+#else
+  auto const& mtime = sb.st_mtim;
+#endif
+  st.mtime_ns = static_cast<std::int64_t>(mtime.tv_sec) * 1'000'000'000 + mtime.tv_nsec;
+  st.inode    = static_cast<std::uint64_t>(sb.st_ino);
+  return true;
+#else
+  std::error_code ec;
+  auto            size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return false;
+  auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec)
+    return false;
+  st.size     = size;
+  st.mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count();
+  st.inode    = 0;
+  return true;
+#endif
+}
+
+void nsstatcache::load(std::filesystem::path const& path)
+{
+  std::scoped_lock guard{lock};
+  start_ns = now_ns();
+  // Already in memory, a resident nsbuild keeps the manifest between checks
+  if (loaded == path)
+    return;
+  entries.clear();
+  loaded = path;
+
+  std::ifstream file(path);
+  std::string   line;
+  if (!std::getline(file, line) || line != k_header)
+    return;
+  while (std::getline(file, line))
+  {
+    std::istringstream iss(line);
+    entry              e;
+    iss >> e.st.size >> e.st.mtime_ns >> e.st.inode >> e.digest;
+    iss.get();
+    std::string name;
+    std::getline(iss, name);
+    if (iss.fail() || name.empty() || e.digest.empty())
+      continue;
+    entries[std::move(name)] = std::move(e);
+  }
+}
+
+void nsstatcache::save(std::filesystem::path const& path, bool prune) const
+{
+  std::ofstream file(path);
+  if (!file.is_open())
+    return;
+
+  file << k_header << "\n";
+  auto racy = (start_ns ? start_ns : now_ns()) - k_racy_window_ns;
+  for (auto const& e : entries)
+  {
+    if ((prune && !e.second.used) || e.second.st.mtime_ns >= racy)
+      continue;
+    file << e.second.st.size << " " << e.second.st.mtime_ns << " " << e.second.st.inode << " " << e.second.digest << " "
+         << e.first << "\n";
+  }
+}
+
+std::string nsstatcache::digest(std::filesystem::path const& path)
+{
+  stamp st;
+  if (!get_stamp(path, st))
+    return {};
+
+  auto name = path.generic_string();
+  {
+    std::scoped_lock guard{lock};
+    auto             it = entries.find(name);
+    if (it != entries.end() && it->second.st == st)
+    {
+      nsprofile::touch();
+      it->second.used = true;
+      return it->second.digest;
+    }
+  }
+
+  std::ifstream iff(path, std::ios::binary);
+  if (!iff.is_open())
+    return {};
+  std::string content;
+  content.resize(st.size);
+  iff.read(content.data(), static_cast<std::streamsize>(content.size()));
+  bool complete = static_cast<std::uint64_t>(iff.gcount()) == st.size;
+  content.resize(static_cast<std::size_t>(iff.gcount()));
+  nsprofile::touch(content.size());
+
+  auto sha = nshash::fast_hex(content);
+  // Modified while being read, the stamp does not describe what was hashed
+  if (!complete)
+    return sha;
+
+  std::scoped_lock guard{lock};
+  auto&            e = entries[name];
+  e.st               = st;
+  e.digest           = sha;
+  e.used             = true;
+  return sha;
+}
@@ -0,0 +1,315 @@
+#include "nsstatedb.h"
+
+#include "nshash.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+namespace
+{
+constexpr char          k_magic[4] = {'N', 'S', 'D', 'B'};
+constexpr std::uint32_t k_version  = 1;
+constexpr std::size_t   k_header   = sizeof(k_magic) + sizeof(k_version);
+constexpr std::uint32_t k_erased   = 0xFFFFFFFF;
+
+// Below this size the store is only appended to, above it it is compacted once half of it is dead
+constexpr std::size_t k_compact_min = 64 * 1024;
+
+inline std::size_t record_size(std::size_t key, std::size_t value)
+{
+  return 2 * sizeof(std::uint32_t) + key + value + sizeof(std::uint32_t);
+}
+
+inline void put_u32(std::string& out, std::uint32_t v)
+{
+  char b[4];
+  std::memcpy(b, &v, 4);
+  out.append(b, 4);
+}
+
+inline std::uint32_t get_u32(char const* p)
+{
+  std::uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+void write_record(std::string& out, std::string_view key, std::string_view value, bool erased)
+{
+  auto start = out.size();
+  put_u32(out, static_cast<std::uint32_t>(key.size()));
+  put_u32(out, erased ? k_erased : static_cast<std::uint32_t>(value.size()));
+  out.append(key);
+  if (!erased)
+    out.append(value);
+  put_u32(out, static_cast<std::uint32_t>(nshash::fast(std::string_view(out).substr(start))));
+}
+} // namespace
+
+nsstatedb::~nsstatedb()
+{
+  try
+  {
+    flush();
+  }
+  catch (...)
+  {
+  }
+}
+
+void nsstatedb::open(std::filesystem::path const& path)
+{
+  std::unique_lock guard{lock};
+  // Already open, a resident nsbuild keeps the store between checks
+  if (file == path)
+  {
+    if (changed())
+      load();
+    return;
+  }
+  values.clear();
+  owned.clear();
+  pending.clear();
+  legacy.clear();
+  file = path;
+
+  bool exists = std::filesystem::exists(path);
+  load();
+  if (!exists)
+    import_legacy();
+}
+
+bool nsstatedb::changed() const
+{
+  nsstatcache::stamp st;
+  if (!nsstatcache::get_stamp(file, st))
+    st = {};
+  return st != disk;
+}
+
+void nsstatedb::load()
+{
+  // Unflushed changes are kept on top of what is on disk now
+  values.clear();
+  owned.clear();
+  mapped.close();
+  file_bytes = 0;
+  rewrite    = false;
+  if (!nsstatcache::get_stamp(file, disk))
+    disk = {};
+
+  if (disk.size && mapped.open(file))
+  {
+    auto data = mapped.view();
+    if (data.size() >= k_header && std::memcmp(data.data(), k_magic, sizeof(k_magic)) == 0 &&
+        get_u32(data.data() + sizeof(k_magic)) == k_version)
+      index(data);
+  }
+  if (file_bytes < k_header)
+    rewrite = true;
+  if (!pending.empty())
+    apply(owned.emplace_back(pending), 0);
+}
+
+void nsstatedb::index(std::string_view data)
+{
+  auto pos = apply(data, k_header);
+  // Anything after pos is a torn write, it is dropped by the next compaction
+  file_bytes = pos;
+  rewrite    = pos != data.size();
+}
+
+std::size_t nsstatedb::apply(std::string_view data, std::size_t pos)
+{
+  while (data.size() - pos >= record_size(0, 0))
+  {
+    auto key_size   = get_u32(data.data() + pos);
+    auto value_size = get_u32(data.data() + pos + 4);
+    bool erased     = value_size == k_erased;
+    auto size       = record_size(key_size, erased ? 0 : value_size);
+    if (data.size() - pos < size)
+      break;
+    auto body = data.substr(pos, size - sizeof(std::uint32_t));
+    if (get_u32(data.data() + pos + body.size()) != static_cast<std::uint32_t>(nshash::fast(body)))
+      break;
+
+    auto key = body.substr(8, key_size);
+    if (erased)
+      values.erase(key);
+    else
+      values[key] = body.substr(8 + key_size);
+    pos += size;
+  }
+  return pos;
+}
+
+void nsstatedb::import_legacy()
+{
+  std::error_code ec;
+  auto            dir = file.parent_path();
+  for (auto const& it : std::filesystem::directory_iterator(dir, ec))
+  {
+    if (!it.is_regular_file())
+      continue;
+    auto        ext = it.path().extension();
+    std::string prefix;
+    if (ext == ".sha")
+      prefix = "sha/";
+    else if (ext == ".glob")
+      prefix = "glob/";
+    else if (ext == ".fetch")
+      prefix = "fetch/";
+    else
+      continue;
+
+    std::ifstream iff{it.path()};
+    std::string   value;
+    iff >> value;
+    auto& key = owned.emplace_back(prefix + it.path().stem().string());
+    auto& val = owned.emplace_back(std::move(value));
+    values[key] = val;
+    legacy.emplace_back(it.path());
+  }
+}
+
+bool nsstatedb::matches(std::string_view key, std::string_view value) const
+{
+  std::shared_lock guard{lock};
+  auto             it = values.find(key);
+  return it != values.end() && it->second == value;
+}
+
+bool nsstatedb::get(std::string_view key, std::string& value) const
+{
+  std::shared_lock guard{lock};
+  auto             it = values.find(key);
+  if (it == values.end())
+    return false;
+  value = it->second;
+  return true;
+}
+
+void nsstatedb::put(std::string_view key, std::string_view value)
+{
+  std::unique_lock guard{lock};
+  auto             it = values.find(key);
+  if (it != values.end() && it->second == value)
+    return;
+  auto& record = owned.emplace_back();
+  record.reserve(key.size() + value.size());
+  record.append(key);
+  record.append(value);
+  std::string_view k{record.data(), key.size()};
+  std::string_view v{record.data() + key.size(), value.size()};
+  if (it != values.end())
+    values.erase(it);
+  values.emplace(k, v);
+  write_record(pending, key, value, false);
+}
+
+void nsstatedb::erase(std::string_view key)
+{
+  std::unique_lock guard{lock};
+  auto             it = values.find(key);
+  if (it == values.end())
+    return;
+  write_record(pending, key, {}, true);
+  values.erase(it);
+}
+
+void nsstatedb::erase_prefix(std::string_view prefix)
+{
+  std::unique_lock guard{lock};
+  for (auto it = values.begin(); it != values.end();)
+  {
+    if (it->first.starts_with(prefix))
+    {
+      write_record(pending, it->first, {}, true);
+      it = values.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+
+void nsstatedb::flush()
+{
+  std::unique_lock guard{lock};
+  if (file.empty())
+    return;
+  // Another process wrote the store since it was read, compacting from memory would drop its records
+  if (changed())
+    load();
+
+  std::size_t live = k_header;
+  for (auto const& v : values)
+    live += record_size(v.first.size(), v.second.size());
+
+  auto total = file_bytes + pending.size();
+  if (rewrite || (total > k_compact_min && total > 2 * live))
+    compact();
+  else if (!pending.empty())
+  {
+    std::ofstream off{file, std::ios::binary | std::ios::app};
+    if (!off.is_open())
+      return;
+    off.write(pending.data(), static_cast<std::streamsize>(pending.size()));
+    off.close();
+    if (!off)
+      return;
+    file_bytes += pending.size();
+    pending.clear();
+    if (!nsstatcache::get_stamp(file, disk))
+      disk = {};
+  }
+
+  std::error_code ec;
+  for (auto const& l : legacy)
+    std::filesystem::remove(l, ec);
+  legacy.clear();
+}
+
+void nsstatedb::compact()
+{
+  std::string data;
+  data.append(k_magic, sizeof(k_magic));
+  put_u32(data, k_version);
+  for (auto const& v : values)
+    write_record(data, v.first, v.second, false);
+
+  auto tmp = file;
+  tmp += ".tmp";
+  {
+    std::ofstream off{tmp, std::ios::binary | std::ios::trunc};
+    if (!off.is_open())
+      return;
+    off.write(data.data(), static_cast<std::streamsize>(data.size()));
+    off.close();
+    if (!off)
+      return;
+  }
+
+  // Views still point into the old mapping, rebuild them from the new file
+  values.clear();
+  mapped.close();
+  std::error_code ec;
+  std::filesystem::rename(tmp, file, ec);
+  if (ec || !mapped.open(file) || mapped.view().size() != data.size())
+  {
+    // Keep serving from memory, the old file (if any) is left as it was
+    mapped.close();
+    auto& keep = owned.emplace_back(std::move(data));
+    index(keep);
+    rewrite = true;
+  }
+  else
+  {
+    index(mapped.view());
+    owned.clear();
+  }
+  pending.clear();
+  if (!nsstatcache::get_stamp(file, disk))
+    disk = {};
+}
@@ -21,7 +21,7 @@ void nsvars::print(std::ostream& os, output_fmt f, bool ignore_unfiltered, char
     if (has_filters)
     {
       os << start << prefix << v.name << assign << "$<IF:" << sf << ", ";
-      cmake::print(os, cmake::value(v.params, sep));
+      cmake::print(os, cmake::value(v.values, sep));
       os << ", ${" << prefix << v.name << "}>";
       if (f == output_fmt::set_cache)
         os << " CACHE INTERNAL \"\"";
@@ -30,7 +30,7 @@ void nsvars::print(std::ostream& os, output_fmt f, bool ignore_unfiltered, char
     else
     {
       os << start << prefix << v.name << assign;
-      cmake::print(os, cmake::value(v.params, sep));
+      cmake::print(os, cmake::value(v.values, sep));
       if (f == output_fmt::set_cache)
         os << " CACHE INTERNAL \"\"";
       os << end;
@@ -0,0 +1,251 @@
+#include "nswatch.h"
+
+#include "nsbuild.h"
+#include "nshash.h"
+#include "nsjournal.h"
+#include "nslog.h"
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace nswatch
+{
+
+#ifdef __linux__
+namespace
+{
+volatile std::sig_atomic_t s_stop = 0;
+
+void on_stop(int) { s_stop = 1; }
+
+constexpr std::uint32_t k_mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM |
+                                 IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+struct watcher
+{
+  int                                  fd = -1;
+  std::unordered_map<int, std::string> dirs;
+  std::vector<int>                     journals;
+
+  /// @brief Watches dir and every directory below it, inotify does not recurse on its own
+  bool add_tree(std::filesystem::path const& dir)
+  {
+    if (!add(dir))
+      return false;
+    std::error_code ec;
+    auto            it = std::filesystem::recursive_directory_iterator(
+        dir, std::filesystem::directory_options::skip_permission_denied, ec);
+    for (auto end = std::filesystem::recursive_directory_iterator(); !ec && it != end; it.increment(ec))
+    {
+      // Fetch mirrors are only ever changed by nsbuild itself
+      if (it.depth() == 0 && it->path().filename() == ".mirrors")
+      {
+        it.disable_recursion_pending();
+        continue;
+      }
+      if (it->is_directory(ec) && !it->is_symlink(ec) && !add(it->path()))
+        return false;
+    }
+    return true;
+  }
+
+  bool add(std::filesystem::path const& dir)
+  {
+    int wd = ::inotify_add_watch(fd, dir.c_str(), k_mask);
+    if (wd < 0)
+    {
+      // Directories can disappear between listing and watching, anything else means events would be lost
+      if (errno == ENOENT || errno == ENOTDIR)
+        return true;
+      nslog::error(fmt::format("Cannot watch {}: {}{}", dir.generic_string(), std::strerror(errno),
+                               errno == ENOSPC ? " (raise fs.inotify.max_user_watches)" : ""));
+      return false;
+    }
+    // A moved directory keeps its watch, the path is updated when it is added again
+    dirs[wd] = dir.generic_string();
+    return true;
+  }
+
+  void append(std::string const& lines)
+  {
+    for (auto j : journals)
+    {
+      auto data = lines.data();
+      auto size = lines.size();
+      while (size)
+      {
+        auto n = ::write(j, data, size);
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n <= 0)
+          break;
+        data += n;
+        size -= static_cast<std::size_t>(n);
+      }
+    }
+  }
+};
+
+int open_journal(std::filesystem::path const& file, std::string const& header)
+{
+  int fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    nslog::error(fmt::format("Cannot open {}: {}", file.generic_string(), std::strerror(errno)));
+    return -1;
+  }
+  if (::flock(fd, LOCK_EX | LOCK_NB) != 0)
+  {
+    nslog::error(fmt::format("Another nsbuild --watch is writing {}", file.generic_string()));
+    ::close(fd);
+    return -1;
+  }
+  // A new session, checks fall back to a full scan until they have committed a position in it
+  if (::ftruncate(fd, 0) != 0 || ::write(fd, header.data(), header.size()) != static_cast<ssize_t>(header.size()))
+  {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+} // namespace
+
+int watch(nsbuild& bc)
+{
+  bc.compute_paths({});
+
+  auto now    = std::chrono::system_clock::now().time_since_epoch().count();
+  auto header = fmt::format("{}{}\n", nsjournal::k_header, nshash::fast_hex(fmt::format("{}:{}", ::getpid(), now)));
+
+  watcher w;
+  for (auto const& preset : bc.presets)
+  {
+    auto dir = bc.get_full_out_dir() / preset.name / bc.cache_dir;
+    std::filesystem::create_directories(dir);
+    int j = open_journal(dir / "watch.journal", header);
+    if (j < 0)
+    {
+      for (auto o : w.journals)
+        ::close(o);
+      return -1;
+    }
+    w.journals.push_back(j);
+  }
+  if (w.journals.empty())
+  {
+    nslog::error("No presets to keep a journal for");
+    return -1;
+  }
+
+  std::vector<std::filesystem::path> roots = {bc.get_full_source_dir() / bc.frameworks_dir, bc.get_full_dl_dir()};
+
+  w.fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (w.fd < 0 || !std::ranges::all_of(roots, [&w](auto const& r) { return w.add_tree(r); }))
+  {
+    if (w.fd >= 0)
+      ::close(w.fd);
+    for (auto j : w.journals)
+      ::close(j);
+    return -1;
+  }
+
+  struct sigaction sa
+  {
+  };
+  sa.sa_handler = on_stop;
+  sigemptyset(&sa.sa_mask);
+  ::sigaction(SIGINT, &sa, nullptr);
+  ::sigaction(SIGTERM, &sa, nullptr);
+
+  nslog::print(fmt::format("Watching {} directories for {} preset(s)", w.dirs.size(), w.journals.size()));
+  std::fflush(stdout);
+
+  alignas(inotify_event) char buffer[64 * 1024];
+  while (!s_stop)
+  {
+    pollfd pfd{w.fd, POLLIN, 0};
+    if (::poll(&pfd, 1, 500) <= 0)
+      continue;
+
+    std::set<std::string> changed;
+    bool                  lost = false;
+    while (true)
+    {
+      auto n = ::read(w.fd, buffer, sizeof(buffer));
+      if (n <= 0)
+        break;
+      for (char const* p = buffer; p < buffer + n;)
+      {
+        auto const* ev = reinterpret_cast<inotify_event const*>(p);
+        p += sizeof(inotify_event) + ev->len;
+
+        if (ev->mask & IN_Q_OVERFLOW)
+        {
+          lost = true;
+          continue;
+        }
+        auto it = w.dirs.find(ev->wd);
+        if (it == w.dirs.end())
+          continue;
+        if (ev->mask & IN_IGNORED)
+        {
+          w.dirs.erase(it);
+          continue;
+        }
+
+        std::filesystem::path path = it->second;
+        if (ev->len)
+          path /= ev->name;
+        // Files created before the new directory is watched are covered by the directory entry itself
+        if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)) && !w.add_tree(path))
+          lost = true;
+        changed.emplace(path.generic_string());
+      }
+    }
+
+    std::string lines;
+    for (auto const& c : changed)
+    {
+      lines += c;
+      lines += '\n';
+    }
+    if (lost)
+    {
+      lines += nsjournal::k_overflow;
+      lines += '\n';
+    }
+    if (!lines.empty())
+      w.append(lines);
+  }
+
+  ::close(w.fd);
+  for (auto j : w.journals)
+    ::close(j);
+  return 0;
+}
+
+#else
+
+int watch(nsbuild&)
+{
+  nslog::error("nsbuild --watch is not supported on this platform");
+  return -1;
+}
+
+#endif
+
+} // namespace nswatch